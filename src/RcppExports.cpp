@@ -10,72 +10,316 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// solar_session
+SEXP solar_session(SEXP share);
+RcppExport SEXP _solareclipser_solar_session(SEXP shareSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type share(shareSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_session(share));
+    return rcpp_result_gen;
+END_RCPP
+}
 // solar_load_pedigree
-int solar_load_pedigree(std::string pedigree_filename, double threshold, std::string output_dir);
-RcppExport SEXP _solareclipser_solar_load_pedigree(SEXP pedigree_filenameSEXP, SEXP thresholdSEXP, SEXP output_dirSEXP) {
+int solar_load_pedigree(std::string pedigree_filename, double threshold, std::string output_dir, SEXP session);
+RcppExport SEXP _solareclipser_solar_load_pedigree(SEXP pedigree_filenameSEXP, SEXP thresholdSEXP, SEXP output_dirSEXP, SEXP sessionSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type pedigree_filename(pedigree_filenameSEXP);
     Rcpp::traits::input_parameter< double >::type threshold(thresholdSEXP);
     Rcpp::traits::input_parameter< std::string >::type output_dir(output_dirSEXP);
-    rcpp_result_gen = Rcpp::wrap(solar_load_pedigree(pedigree_filename, threshold, output_dir));
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_load_pedigree(pedigree_filename, threshold, output_dir, session));
     return rcpp_result_gen;
 END_RCPP
 }
 // solar_load_phenotype
-int solar_load_phenotype(std::string phenotype_filename);
-RcppExport SEXP _solareclipser_solar_load_phenotype(SEXP phenotype_filenameSEXP) {
+int solar_load_phenotype(std::string phenotype_filename, Rcpp::CharacterVector columns, SEXP session);
+RcppExport SEXP _solareclipser_solar_load_phenotype(SEXP phenotype_filenameSEXP, SEXP columnsSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type phenotype_filename(phenotype_filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_load_phenotype(phenotype_filename, columns, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_cache_phenotype
+int solar_cache_phenotype(std::string phenotype_filename);
+RcppExport SEXP _solareclipser_solar_cache_phenotype(SEXP phenotype_filenameSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type phenotype_filename(phenotype_filenameSEXP);
-    rcpp_result_gen = Rcpp::wrap(solar_load_phenotype(phenotype_filename));
+    rcpp_result_gen = Rcpp::wrap(solar_cache_phenotype(phenotype_filename));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_load_pedigree_data
+int solar_load_pedigree_data(SEXP pedigree, double threshold, std::string output_dir, SEXP session);
+RcppExport SEXP _solareclipser_solar_load_pedigree_data(SEXP pedigreeSEXP, SEXP thresholdSEXP, SEXP output_dirSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type pedigree(pedigreeSEXP);
+    Rcpp::traits::input_parameter< double >::type threshold(thresholdSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output_dir(output_dirSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_load_pedigree_data(pedigree, threshold, output_dir, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_load_phenotype_data
+int solar_load_phenotype_data(SEXP phenotypes, Rcpp::CharacterVector columns, SEXP session);
+RcppExport SEXP _solareclipser_solar_load_phenotype_data(SEXP phenotypesSEXP, SEXP columnsSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type phenotypes(phenotypesSEXP);
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_load_phenotype_data(phenotypes, columns, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_load_genotypes
+int solar_load_genotypes(SEXP genotypes, SEXP session);
+RcppExport SEXP _solareclipser_solar_load_genotypes(SEXP genotypesSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type genotypes(genotypesSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_load_genotypes(genotypes, session));
     return rcpp_result_gen;
 END_RCPP
 }
 // solar_select_trait
-int solar_select_trait(std::string trait_name);
-RcppExport SEXP _solareclipser_solar_select_trait(SEXP trait_nameSEXP) {
+int solar_select_trait(std::string trait_name, SEXP session);
+RcppExport SEXP _solareclipser_solar_select_trait(SEXP trait_nameSEXP, SEXP sessionSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type trait_name(trait_nameSEXP);
-    rcpp_result_gen = Rcpp::wrap(solar_select_trait(trait_name));
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_select_trait(trait_name, session));
     return rcpp_result_gen;
 END_RCPP
 }
 // solar_run_fphi
-int solar_run_fphi(std::string output_basename);
-RcppExport SEXP _solareclipser_solar_run_fphi(SEXP output_basenameSEXP) {
+int solar_run_fphi(std::string output_basename, SEXP session);
+RcppExport SEXP _solareclipser_solar_run_fphi(SEXP output_basenameSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type output_basename(output_basenameSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_run_fphi(output_basename, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_run_fphi_batch
+int solar_run_fphi_batch(Rcpp::CharacterVector traits, std::string output_basename, SEXP session);
+RcppExport SEXP _solareclipser_solar_run_fphi_batch(SEXP traitsSEXP, SEXP output_basenameSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type traits(traitsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output_basename(output_basenameSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_run_fphi_batch(traits, output_basename, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_fphi
+SEXP solar_fphi(Rcpp::CharacterVector traits, std::string output_basename, SEXP session);
+RcppExport SEXP _solareclipser_solar_fphi(SEXP traitsSEXP, SEXP output_basenameSEXP, SEXP sessionSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type traits(traitsSEXP);
     Rcpp::traits::input_parameter< std::string >::type output_basename(output_basenameSEXP);
-    rcpp_result_gen = Rcpp::wrap(solar_run_fphi(output_basename));
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_fphi(traits, output_basename, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_get_evd
+SEXP solar_get_evd(SEXP session);
+RcppExport SEXP _solareclipser_solar_get_evd(SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_get_evd(session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_read_evd
+SEXP solar_read_evd(std::string path, bool verify);
+RcppExport SEXP _solareclipser_solar_read_evd(SEXP pathSEXP, SEXP verifySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< bool >::type verify(verifySEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_read_evd(path, verify));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_project_traits
+SEXP solar_project_traits(Rcpp::CharacterVector traits, SEXP session);
+RcppExport SEXP _solareclipser_solar_project_traits(SEXP traitsSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type traits(traitsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_project_traits(traits, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_set_block_evd
+void solar_set_block_evd(bool enabled, SEXP session);
+RcppExport SEXP _solareclipser_solar_set_block_evd(SEXP enabledSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< bool >::type enabled(enabledSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    solar_set_block_evd(enabled, session);
+    return R_NilValue;
+END_RCPP
+}
+// solar_set_write_evd
+void solar_set_write_evd(bool enabled, SEXP session);
+RcppExport SEXP _solareclipser_solar_set_write_evd(SEXP enabledSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< bool >::type enabled(enabledSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    solar_set_write_evd(enabled, session);
+    return R_NilValue;
+END_RCPP
+}
+// solar_set_eigen_solver
+int solar_set_eigen_solver(std::string solver, SEXP session);
+RcppExport SEXP _solareclipser_solar_set_eigen_solver(SEXP solverSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type solver(solverSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_set_eigen_solver(solver, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_set_threads
+int solar_set_threads(int threads, SEXP session);
+RcppExport SEXP _solareclipser_solar_set_threads(SEXP threadsSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_set_threads(threads, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_set_evd_cache
+int solar_set_evd_cache(double memory_mb, double disk_mb, std::string directory, SEXP session);
+RcppExport SEXP _solareclipser_solar_set_evd_cache(SEXP memory_mbSEXP, SEXP disk_mbSEXP, SEXP directorySEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type memory_mb(memory_mbSEXP);
+    Rcpp::traits::input_parameter< double >::type disk_mb(disk_mbSEXP);
+    Rcpp::traits::input_parameter< std::string >::type directory(directorySEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_set_evd_cache(memory_mb, disk_mb, directory, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_set_evd_downdate
+int solar_set_evd_downdate(double crossover, SEXP session);
+RcppExport SEXP _solareclipser_solar_set_evd_downdate(SEXP crossoverSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type crossover(crossoverSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_set_evd_downdate(crossover, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_set_evd_truncation
+int solar_set_evd_truncation(double rank, double tolerance, SEXP session);
+RcppExport SEXP _solareclipser_solar_set_evd_truncation(SEXP rankSEXP, SEXP toleranceSEXP, SEXP sessionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type rank(rankSEXP);
+    Rcpp::traits::input_parameter< double >::type tolerance(toleranceSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    rcpp_result_gen = Rcpp::wrap(solar_set_evd_truncation(rank, tolerance, session));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solar_build_info
+List solar_build_info();
+RcppExport SEXP _solareclipser_solar_build_info() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(solar_build_info());
     return rcpp_result_gen;
 END_RCPP
 }
 // solar_reset
-void solar_reset();
-RcppExport SEXP _solareclipser_solar_reset() {
+void solar_reset(SEXP session);
+RcppExport SEXP _solareclipser_solar_reset(SEXP sessionSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
-    solar_reset();
+    Rcpp::traits::input_parameter< SEXP >::type session(sessionSEXP);
+    solar_reset(session);
     return R_NilValue;
 END_RCPP
 }
 
+void init_evd_altrep(DllInfo* dll);
+
 static const R_CallMethodDef CallEntries[] = {
-    {"_solareclipser_solar_load_pedigree", (DL_FUNC) &_solareclipser_solar_load_pedigree, 3},
-    {"_solareclipser_solar_load_phenotype", (DL_FUNC) &_solareclipser_solar_load_phenotype, 1},
-    {"_solareclipser_solar_select_trait", (DL_FUNC) &_solareclipser_solar_select_trait, 1},
-    {"_solareclipser_solar_run_fphi", (DL_FUNC) &_solareclipser_solar_run_fphi, 1},
-    {"_solareclipser_solar_reset", (DL_FUNC) &_solareclipser_solar_reset, 0},
+    {"_solareclipser_solar_session", (DL_FUNC) &_solareclipser_solar_session, 1},
+    {"_solareclipser_solar_load_pedigree", (DL_FUNC) &_solareclipser_solar_load_pedigree, 4},
+    {"_solareclipser_solar_load_phenotype", (DL_FUNC) &_solareclipser_solar_load_phenotype, 3},
+    {"_solareclipser_solar_cache_phenotype", (DL_FUNC) &_solareclipser_solar_cache_phenotype, 1},
+    {"_solareclipser_solar_load_pedigree_data", (DL_FUNC) &_solareclipser_solar_load_pedigree_data, 4},
+    {"_solareclipser_solar_load_phenotype_data", (DL_FUNC) &_solareclipser_solar_load_phenotype_data, 3},
+    {"_solareclipser_solar_load_genotypes", (DL_FUNC) &_solareclipser_solar_load_genotypes, 2},
+    {"_solareclipser_solar_select_trait", (DL_FUNC) &_solareclipser_solar_select_trait, 2},
+    {"_solareclipser_solar_run_fphi", (DL_FUNC) &_solareclipser_solar_run_fphi, 2},
+    {"_solareclipser_solar_run_fphi_batch", (DL_FUNC) &_solareclipser_solar_run_fphi_batch, 3},
+    {"_solareclipser_solar_fphi", (DL_FUNC) &_solareclipser_solar_fphi, 3},
+    {"_solareclipser_solar_get_evd", (DL_FUNC) &_solareclipser_solar_get_evd, 1},
+    {"_solareclipser_solar_read_evd", (DL_FUNC) &_solareclipser_solar_read_evd, 2},
+    {"_solareclipser_solar_project_traits", (DL_FUNC) &_solareclipser_solar_project_traits, 2},
+    {"_solareclipser_solar_set_block_evd", (DL_FUNC) &_solareclipser_solar_set_block_evd, 2},
+    {"_solareclipser_solar_set_write_evd", (DL_FUNC) &_solareclipser_solar_set_write_evd, 2},
+    {"_solareclipser_solar_set_eigen_solver", (DL_FUNC) &_solareclipser_solar_set_eigen_solver, 2},
+    {"_solareclipser_solar_set_threads", (DL_FUNC) &_solareclipser_solar_set_threads, 2},
+    {"_solareclipser_solar_set_evd_cache", (DL_FUNC) &_solareclipser_solar_set_evd_cache, 4},
+    {"_solareclipser_solar_set_evd_downdate", (DL_FUNC) &_solareclipser_solar_set_evd_downdate, 2},
+    {"_solareclipser_solar_set_evd_truncation", (DL_FUNC) &_solareclipser_solar_set_evd_truncation, 3},
+    {"_solareclipser_solar_build_info", (DL_FUNC) &_solareclipser_solar_build_info, 0},
+    {"_solareclipser_solar_reset", (DL_FUNC) &_solareclipser_solar_reset, 1},
     {NULL, NULL, 0}
 };
 
 RcppExport void R_init_solareclipser(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    init_evd_altrep(dll);
 }
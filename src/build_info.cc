@@ -0,0 +1,67 @@
+/*
+ * build_info.cc - Optional features and libraries compiled into the package
+ */
+
+#include <zlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Eigen/Core"
+#include "build_info.h"
+#include "number_parse.h"
+
+bool BuildInfo::openmp() {
+#ifdef _OPENMP
+    return true;
+#else
+    return false;
+#endif
+}
+
+int BuildInfo::openmp_version() {
+#ifdef _OPENMP
+    return _OPENMP;
+#else
+    return 0;
+#endif
+}
+
+int BuildInfo::openmp_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+void BuildInfo::single_threaded_openmp() {
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+}
+
+std::string BuildInfo::eigen() {
+    return std::to_string(EIGEN_WORLD_VERSION) + "." + std::to_string(EIGEN_MAJOR_VERSION) + "." +
+           std::to_string(EIGEN_MINOR_VERSION);
+}
+
+std::string BuildInfo::zlib() {
+    return ZLIB_VERSION;
+}
+
+bool BuildInfo::sse2() {
+#if defined(__SSE2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool BuildInfo::from_chars() {
+#if defined(__cpp_lib_to_chars)
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,40 @@
+/*
+ * build_info.h - Optional features and libraries compiled into the package
+ * Reported to R by solar_build_info(); everything here is fixed when the
+ * package is compiled (the BLAS/LAPACK in use is asked of R at run time)
+ */
+
+#ifndef BUILD_INFO_H
+#define BUILD_INFO_H
+
+#include <string>
+
+class BuildInfo {
+public:
+    // Compiled with OpenMP (SHLIB_OPENMP_CXXFLAGS was non-empty)
+    static bool openmp();
+
+    // _OPENMP specification date (yyyymm), 0 without OpenMP
+    static int openmp_version();
+
+    // Threads an OpenMP region would use, 1 without OpenMP
+    static int openmp_threads();
+
+    // Limit OpenMP on the calling thread to one thread, so kernels run
+    // from a parallel loop do not start nested teams; no-op without OpenMP
+    static void single_threaded_openmp();
+
+    // Bundled Eigen version ("3.3.2")
+    static std::string eigen();
+
+    // zlib version the package was compiled against
+    static std::string zlib();
+
+    // SSE2 CSV tokenizer compiled in
+    static bool sse2();
+
+    // Numbers parsed with std::from_chars (otherwise strtod)
+    static bool from_chars();
+};
+
+#endif // BUILD_INFO_H
@@ -3,9 +3,12 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
 #include <cstring>
-#include <zlib.h>
-#include <map>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <unordered_map>
 
 #include <Rcpp.h>
 #define COUT Rcpp::Rcout
@@ -13,23 +16,258 @@
 
 #include "Eigen/Dense"
 #include "create_evd.h"
+#include "evd.h"
+#include "evd_file.h"
+#include "kinship_matrix.h"
+#include "log_sink.h"
+#include "parallel_for.h"
 #include "pedigree.h"
 #include "phenotypes.h"
+#include "randomized_evd.h"
 
-// FORTRAN eigenvalue decomposition routine
-extern "C" void symeig_(int* n, double* a, double* d, double* e, double* z, int* info);
+// Eigendecompose one diagonal block of phi2 in place
+// (position maps each EVD row to its index within its own block)
+static int decompose_block(const KinshipMatrix& phi2,
+                           const std::vector<int>& position,
+                           EigenSolverBackend solver,
+                           EvdBlock& block) {
+    size_t n = block.size();
+
+    // Singleton family: the 1 x 1 block is its own decomposition
+    if (n == 1) {
+        block.values.assign(1, phi2.get(block.rows[0], block.rows[0]));
+        block.vectors.assign(1, 1.0);
+        return 0;
+    }
+
+    // Scatter the block's sparse phi2 rows into a dense column-major matrix
+    std::vector<double> phi2_array(n * n);
+    phi2.fill_dense(block.rows, position, phi2_array.data());
+
+    // Eigenvalues come back in ascending order from every backend
+    return EigenSolver::decompose(solver, static_cast<int>(n), phi2_array, block.values, block.vectors);
+}
+
+// Write <basename>.ids and <basename>.notes describing the selected IDs
+static int write_id_files(const Phenotypes* phenotypes,
+                          const std::vector<std::string>& trait_names,
+                          const std::vector<std::string>& valid_ids,
+                          const char* output_basename) {
+    // Create output files (simplified version)
+    std::string ids_filename = std::string(output_basename) + ".ids";
+    std::string notes_filename = std::string(output_basename) + ".notes";
+    
+    // Write IDs file
+    std::ofstream ids_file(ids_filename);
+    if (!ids_file) {
+        CERR << "Error: Cannot create output file " << ids_filename << std::endl;
+        return 1;
+    }
+    
+    for (size_t i = 0; i < valid_ids.size(); i++) {
+        if (i > 0) ids_file << " ";
+        ids_file << valid_ids[i];
+    }
+    ids_file.close();
+    
+    // Write notes file
+    std::ofstream notes_file(notes_filename);
+    if (!notes_file) {
+        CERR << "Error: Cannot create notes file " << notes_filename << std::endl;
+        return 1;
+    }
+    
+    notes_file << "Number of IDs: " << valid_ids.size() << std::endl;
+    notes_file << "Phenotype filename used for ID selection: " << phenotypes->get_filename() << std::endl;
+    if (trait_names.size() == 1) {
+        notes_file << "Trait used for ID selection: " << trait_names[0] << std::endl;
+    } else {
+        notes_file << "Number of traits used for ID selection: " << trait_names.size() << std::endl;
+    }
+    notes_file.close();
+
+    return 0;
+}
+
+// phi2.gz is created by PedigreeLoader in the output directory, which is
+// the directory part of output_basename
+static std::string phi2_path_for(const char* output_basename) {
+    std::string basename_str(output_basename);
+    size_t last_slash = basename_str.find_last_of("/\\");
+    if (last_slash == std::string::npos) {
+        return "phi2.gz";
+    }
+    return basename_str.substr(0, last_slash) + "/phi2.gz";
+}
+
+// 1-based phi2 indices of ids (looked up in the pedigree's ID dictionary)
+static int find_phi2_indices(const Pedigree* pedigree, const std::vector<std::string>& ids,
+                             std::vector<int>& phi2_indices) {
+    const IdDictionary& pedigree_ids = pedigree->ids();
+    phi2_indices.clear();
+    for (const auto& id : ids) {
+        int index = pedigree_ids.find(id);
+        if (index == IdDictionary::npos) {
+            CERR << "Error: ID " << id << " not found in pedigree index" << std::endl;
+            return 1;
+        }
+        phi2_indices.push_back(index + 1);  // 1-based indexing for phi2
+    }
+    return 0;
+}
+
+// Decompose phi2 (row i = ids[i], at phi2 index phi2_indices[i]) into evd.
+// Diagnostics go through the log sink, so this may run on a pool worker
+static int decompose_phi2(const Pedigree* pedigree,
+                          const KinshipMatrix& phi2,
+                          const std::vector<int>& phi2_indices,
+                          const std::vector<std::string>& ids,
+                          const EvdOptions& options,
+                          Evd& evd) {
+    size_t n = ids.size();
+
+    if (options.is_truncated()) {
+        RandomizedEvdReport report;
+        evd = Evd();
+        if (RandomizedEvd::decompose(phi2, options.truncated_rank, options.truncated_tolerance, options.solver,
+                                     evd, report) != 0) {
+            return 1;
+        }
+        evd.ids = ids;
+        if (evd.num_remainder() == 0) {
+            LogSink::info("  Truncated EVD: rank covers all " + std::to_string(n) + " subjects, decomposed exactly");
+            return 0;
+        }
+        char text[256];
+        std::snprintf(text, sizeof(text),
+                      "  Truncated EVD: %zu of %zu components after %zu iterations (max residual %.2g%s); "
+                      "remaining %zu eigenvalues fitted as %.6g (RMS spread %.3g)",
+                      report.rank, n, report.iterations, report.max_residual,
+                      report.converged ? "" : ", not converged", evd.num_remainder(),
+                      report.remainder_mean, report.remainder_spread);
+        LogSink::info(text);
+        if (!report.tolerance_met) {
+            LogSink::error("Warning: Truncated EVD stopped at " + std::to_string(report.rank) +
+                           " components without reaching the spread tolerance");
+        }
+        return 0;
+    }
+
+    // Partition subjects into diagonal blocks: one per family in block mode
+    // (phi2 has no entries between families), otherwise one dense block
+    evd = Evd();
+    evd.ids = ids;
+    if (options.block_diagonal) {
+        const std::vector<int>& family_ids = pedigree->family_ids();
+        std::unordered_map<int, size_t> block_of_family;
+        for (size_t i = 0; i < n; i++) {
+            int family = family_ids[phi2_indices[i] - 1];
+            auto inserted = block_of_family.emplace(family, evd.blocks.size());
+            if (inserted.second) {
+                evd.blocks.emplace_back();
+            }
+            evd.blocks[inserted.first->second].rows.push_back(i);
+        }
+    } else {
+        evd.blocks.resize(1);
+        evd.blocks[0].rows.resize(n);
+        std::iota(evd.blocks[0].rows.begin(), evd.blocks[0].rows.end(), 0);
+    }
+
+    // Decompose the largest blocks first so they do not finish last
+    std::vector<size_t> order(evd.blocks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return evd.blocks[a].size() > evd.blocks[b].size();
+    });
+
+    // Blocks partition the rows, so one position table serves them all
+    std::vector<int> position(n);
+    for (const auto& block : evd.blocks) {
+        for (size_t i = 0; i < block.size(); i++) {
+            position[block.rows[i]] = static_cast<int>(i);
+        }
+    }
+
+    // Failures are reported from the worker, through the log sink
+    std::atomic<bool> failed(false);
+    parallel_for(order.size(), [&](size_t k) {
+        size_t b = order[k];
+        int info = decompose_block(phi2, position, options.solver, evd.blocks[b]);
+        if (info != 0) {
+            int size = static_cast<int>(evd.blocks[b].size());
+            const char* solver_name = EigenSolver::name(EigenSolver::resolve(options.solver, size));
+            LogSink::error(std::string("Error: ") + solver_name + " eigenvalue decomposition of a " +
+                           std::to_string(evd.blocks[b].size()) + "-subject block failed with code " +
+                           std::to_string(info));
+            failed = true;
+        }
+    });
+
+    if (failed) {
+        return 1;
+    }
+
+    if (options.block_diagonal) {
+        LogSink::info("  Decomposed " + std::to_string(evd.blocks.size()) + " family blocks (largest " +
+                      std::to_string(evd.blocks[order[0]].size()) + " subjects)");
+    }
+    return 0;
+}
 
 int CreateEVD::create_evd_data(
-    Pedigree* pedigree,
+    const Pedigree* pedigree,
     Phenotypes* phenotypes,
     const std::string& trait_name,
-    const char* output_basename
+    const char* output_basename,
+    Evd& evd,
+    const EvdOptions& options
+) {
+    if (trait_name.empty()) {
+        CERR << "Error: No trait has been selected" << std::endl;
+        return 1;
+    }
+
+    return create_evd_data(pedigree, phenotypes, std::vector<std::string>{trait_name}, output_basename, evd, options);
+}
+
+int CreateEVD::create_evd_data(
+    const Pedigree* pedigree,
+    Phenotypes* phenotypes,
+    const std::vector<std::string>& trait_names,
+    const char* output_basename,
+    Evd& evd,
+    const EvdOptions& options
 ) {
     if (!output_basename) {
         CERR << "Error: Please enter a base output filename with --o" << std::endl;
         return 1;
     }
 
+    std::vector<std::string> valid_ids;
+    if (select_subjects(pedigree, phenotypes, trait_names, valid_ids) != 0) {
+        return 1;
+    }
+
+    if (options.write_files && write_id_files(phenotypes, trait_names, valid_ids, output_basename) != 0) {
+        return 1;
+    }
+
+    // Read and decompose phi2 matrix
+    if (compute_eigen_decomposition(pedigree, valid_ids, output_basename, evd, options) != 0) {
+        CERR << "Error: Failed to compute eigenvalue decomposition" << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
+
+int CreateEVD::select_subjects(
+    const Pedigree* pedigree,
+    const Phenotypes* phenotypes,
+    const std::vector<std::string>& trait_names,
+    std::vector<std::string>& valid_ids
+) {
     if (!pedigree) {
         CERR << "Error: No pedigree loaded" << std::endl;
         return 1;
@@ -40,119 +278,64 @@ int CreateEVD::create_evd_data(
         return 1;
     }
 
-    if (trait_name.empty()) {
+    if (trait_names.empty()) {
         CERR << "Error: No trait has been selected" << std::endl;
         return 1;
     }
 
-    // Get phenotype data
-    const auto& headers = phenotypes->get_headers();
-    const auto& data = phenotypes->get_data();
-    
-    if (headers.empty() || data.empty()) {
+    if (phenotypes->num_rows() == 0) {
         CERR << "Error: No phenotype data loaded" << std::endl;
         return 1;
     }
-    
-    // Find trait column
-    int trait_col = -1;
-    int id_col = -1;
 
-    for (size_t i = 0; i < headers.size(); i++) {
-        if (headers[i] == "id" || headers[i] == "ID") {
-            id_col = i;
-        }
-        if (headers[i] == trait_name) {
-            trait_col = i;
-        }
-    }
-
-    if (id_col == -1) {
+    if (!phenotypes->has_ids()) {
         CERR << "Error: No 'id' column found in phenotype data" << std::endl;
         return 1;
     }
 
-    if (trait_col == -1) {
-        CERR << "Error: Trait '" << trait_name << "' not found in phenotype data" << std::endl;
-        return 1;
-    }
-    
-    // First collect phenotype IDs with valid trait values
-    std::vector<std::string> phenotype_ids;
-    std::vector<double> trait_values;
-    
-    for (const auto& row : data) {
-        if (row.size() > std::max(id_col, trait_col)) {
-            const std::string& trait_val = row[trait_col];
-            
-            // Check if trait value is not missing (not empty, not "NA", not ".")
-            if (!trait_val.empty() && trait_val != "NA" && trait_val != ".") {
-                try {
-                    double val = std::stod(trait_val);
-                    phenotype_ids.push_back(row[id_col]);
-                    trait_values.push_back(val);
-                } catch (const std::exception&) {
-                    // Skip invalid numeric values
-                }
-            }
+    // Find trait columns
+    std::vector<const double*> trait_columns;
+    for (const auto& trait_name : trait_names) {
+        int index = phenotypes->find_trait(trait_name);
+        if (index == -1) {
+            CERR << "Error: Trait '" << trait_name << "' not found in phenotype data" << std::endl;
+            return 1;
         }
+        trait_columns.push_back(phenotypes->get_trait(index));
     }
-    
-    // Now filter phenotype IDs against pedigree IDs from pedindex.out
-    // This matches the original SOLAR behavior
-    std::vector<std::string> pedigree_ids;
-    // pedindex.out is created by PedigreeLoader in the output directory
-    // Extract output directory from output_basename
-    std::string output_dir;
-    std::string basename_str(output_basename);
-    size_t last_slash = basename_str.find_last_of("/\\");
-    if (last_slash != std::string::npos) {
-        output_dir = basename_str.substr(0, last_slash);
-    }
-    std::string pedindex_path = output_dir.empty() ? "pedindex.out" : output_dir + "/pedindex.out";
-    std::ifstream pedindex_file(pedindex_path);
-    if (!pedindex_file) {
-        CERR << "Error: No pedigree loaded (" << pedindex_path << " not found)" << std::endl;
-        CERR << "Load pedigree first before creating EVD data" << std::endl;
+
+    const IdDictionary& pedigree_ids = pedigree->ids();
+    if (pedigree_ids.empty()) {
+        CERR << "Error: No valid pedigree IDs found" << std::endl;
         return 1;
     }
-    
-    std::string line;
-    while (std::getline(pedindex_file, line)) {
-        // pedindex.out format: sequential_id father mother mztwin family_id generation original_id
-        // We want the original_id (last column)
-        std::istringstream iss(line);
-        std::string token;
-        std::vector<std::string> tokens;
-        while (iss >> token) {
-            tokens.push_back(token);
+
+    // First mark pedigree IDs with valid values for every trait
+    // (missing and non-numeric values are NaN and exclude the row)
+    std::vector<char> has_phenotype(pedigree_ids.size(), 0);
+
+    for (size_t row = 0; row < phenotypes->num_rows(); row++) {
+        bool all_valid = true;
+        for (const double* column : trait_columns) {
+            if (std::isnan(column[row])) {
+                all_valid = false;
+                break;
+            }
         }
-        if (tokens.size() >= 7) {  // Should have 7 columns
-            pedigree_ids.push_back(tokens[6]);  // original_id is last column
+        if (all_valid) {
+            int index = pedigree_ids.find(phenotypes->row_id(row));
+            if (index != IdDictionary::npos) {
+                has_phenotype[index] = 1;
+            }
         }
     }
-    pedindex_file.close();
-    
-    if (pedigree_ids.empty()) {
-        CERR << "Error: No valid pedigree IDs found" << std::endl;
-        return 1;
-    }
-    
-    // Filter phenotype IDs against pedigree
-    
+
     // Filter to IDs that exist in both pedigree and have valid phenotypes
-    // Iterate through pedigree_ids to preserve original pedigree order (matches SOLAR)
-    std::vector<std::string> valid_ids;
-    std::vector<double> filtered_trait_values;
-    
+    // Iterate in pedigree (pedindex.out) order to match the original SOLAR behavior
+    valid_ids.clear();
     for (size_t i = 0; i < pedigree_ids.size(); i++) {
-        const std::string& ped_id = pedigree_ids[i];
-        // Check if this pedigree ID has phenotype data
-        auto pheno_it = std::find(phenotype_ids.begin(), phenotype_ids.end(), ped_id);
-        if (pheno_it != phenotype_ids.end()) {
-            valid_ids.push_back(ped_id);
-            size_t pheno_index = std::distance(phenotype_ids.begin(), pheno_it);
-            filtered_trait_values.push_back(trait_values[pheno_index]);
+        if (has_phenotype[i]) {
+            valid_ids.emplace_back(pedigree_ids.name(i));
         }
     }
     
@@ -161,200 +344,104 @@ int CreateEVD::create_evd_data(
         CERR << "Make sure the same IDs exist in both pedigree and phenotype files" << std::endl;
         return 1;
     }
-    
-    // Found matching IDs
-    
-    // Create output files (simplified version)
-    std::string ids_filename = std::string(output_basename) + ".ids";
-    std::string notes_filename = std::string(output_basename) + ".notes";
-    
-    // Write IDs file
-    std::ofstream ids_file(ids_filename);
-    if (!ids_file) {
-        CERR << "Error: Cannot create output file " << ids_filename << std::endl;
+
+    return 0;
+}
+
+int CreateEVD::write_evd_files(
+    const Phenotypes* phenotypes,
+    const std::vector<std::string>& trait_names,
+    const Evd& evd,
+    const char* output_basename
+) {
+    if (write_id_files(phenotypes, trait_names, evd.ids, output_basename) != 0) {
         return 1;
     }
-    
-    for (size_t i = 0; i < valid_ids.size(); i++) {
-        if (i > 0) ids_file << " ";
-        ids_file << valid_ids[i];
-    }
-    ids_file.close();
-    
-    // Write notes file
-    std::ofstream notes_file(notes_filename);
-    if (!notes_file) {
-        CERR << "Error: Cannot create notes file " << notes_filename << std::endl;
+    return EvdFile::write(evd, std::string(output_basename) + ".evd");
+}
+
+int CreateEVD::compute_eigen_decomposition(const Pedigree* pedigree,
+                                           const std::vector<std::string>& valid_ids,
+                                           const char* output_basename,
+                                           Evd& evd,
+                                           const EvdOptions& options) {
+    // Create mapping from valid_ids to indices in the full phi2 matrix
+    std::vector<int> phi2_indices;
+    if (find_phi2_indices(pedigree, valid_ids, phi2_indices) != 0) {
         return 1;
     }
-    
-    notes_file << "Number of IDs: " << valid_ids.size() << std::endl;
-    notes_file << "Phenotype filename used for ID selection: " << phenotypes->get_filename() << std::endl;
-    notes_file << "Trait used for ID selection: " << trait_name << std::endl;
-    notes_file.close();
-    
-    // Read and decompose phi2 matrix
-    if (compute_eigen_decomposition(valid_ids, output_basename) != 0) {
-        CERR << "Error: Failed to compute eigenvalue decomposition" << std::endl;
+
+    // Read the phi2 entries between selected subjects (row i = valid_ids[i])
+    KinshipMatrix phi2;
+    if (KinshipMatrix::load(phi2_path_for(output_basename), phi2_indices, phi2) != 0) {
         return 1;
     }
-    
-    // EVD files created
-    
-    return 0;
-}
-
-int CreateEVD::compute_eigen_decomposition(const std::vector<std::string>& valid_ids, const char* output_basename) {
-    size_t n = valid_ids.size();
 
-    // Read pedindex.out to get ID mapping
-    // pedindex.out is created by PedigreeLoader in the output directory
-    // Extract output directory from output_basename
-    std::string output_dir;
-    std::string basename_str(output_basename);
-    size_t last_slash = basename_str.find_last_of("/\\");
-    if (last_slash != std::string::npos) {
-        output_dir = basename_str.substr(0, last_slash);
-    }
-    std::string pedindex_path = output_dir.empty() ? "pedindex.out" : output_dir + "/pedindex.out";
-    std::ifstream pedindex_file(pedindex_path);
-    if (!pedindex_file) {
-        CERR << "Error: Cannot read " << pedindex_path << " for ID mapping" << std::endl;
+    if (decompose_phi2(pedigree, phi2, phi2_indices, valid_ids, options, evd) != 0) {
         return 1;
     }
-    
-    std::vector<std::string> all_pedigree_ids;
-    std::string line;
-    while (std::getline(pedindex_file, line)) {
-        std::istringstream iss(line);
-        std::string token;
-        std::vector<std::string> tokens;
-        while (iss >> token) {
-            tokens.push_back(token);
-        }
-        if (tokens.size() >= 7) {
-            all_pedigree_ids.push_back(tokens[6]);  // original_id is last column
-        }
+
+    if (options.write_files) {
+        return EvdFile::write(evd, std::string(output_basename) + ".evd");
     }
-    pedindex_file.close();
-    
-    // Create mapping from valid_ids to indices in the full phi2 matrix
-    std::vector<int> phi2_indices;
-    for (const auto& valid_id : valid_ids) {
-        auto it = std::find(all_pedigree_ids.begin(), all_pedigree_ids.end(), valid_id);
-        if (it != all_pedigree_ids.end()) {
-            phi2_indices.push_back(std::distance(all_pedigree_ids.begin(), it) + 1);  // 1-based indexing for phi2
-        } else {
-            CERR << "Error: ID " << valid_id << " not found in pedigree index" << std::endl;
+    return 0;
+}
+
+int CreateEVD::compute_eigen_decompositions(const Pedigree* pedigree,
+                                            const std::vector<std::vector<std::string>>& subject_sets,
+                                            const char* output_basename,
+                                            std::vector<Evd>& evds,
+                                            const EvdOptions& options) {
+    size_t n_sets = subject_sets.size();
+    std::vector<std::vector<int>> set_indices(n_sets);
+    for (size_t k = 0; k < n_sets; k++) {
+        if (find_phi2_indices(pedigree, subject_sets[k], set_indices[k]) != 0) {
             return 1;
         }
     }
-    
-    // Create phi2 matrix exactly like the original SOLAR implementation
-    double* phi2_array = new double[n * n];
-
-    // Read phi2 data into a map for easier access, matching original SOLAR approach
-    std::map<std::pair<int,int>, double> phi2_data;
-    std::string phi2_path = output_dir.empty() ? "phi2.gz" : output_dir + "/phi2.gz";
-    gzFile phi2_file = gzopen(phi2_path.c_str(), "rt");
-    if (!phi2_file) {
-        CERR << "Error: Cannot open " << phi2_path << " file" << std::endl;
-        return 1;
-    }
-    
-    char buffer[1024];
-    while (gzgets(phi2_file, buffer, sizeof(buffer))) {
-        int row, col;
-        double value;
-        if (sscanf(buffer, "%d %d %lf", &row, &col, &value) == 3) {
-            phi2_data[std::make_pair(row, col)] = value;
-            if (row != col) {
-                phi2_data[std::make_pair(col, row)] = value;  // Ensure symmetry
-            }
+
+    // One read of phi2.gz for the union of the sets, in phi2 order
+    std::vector<int> union_row(pedigree->ids().size() + 1, -1);
+    for (const auto& indices : set_indices) {
+        for (int index : indices) {
+            union_row[index] = 0;
         }
     }
-    gzclose(phi2_file);
-    
-    // Build phi2 matrix exactly like original SOLAR (lines 205-210)
-    // Original: phi2[col*ids.size() + col] = solar_phi2->get(ibdids[col], ibdids[col]);
-    // Original: phi2[col*ids.size() + row] = phi2[row*ids.size() + col] = solar_phi2->get(ibdids[row], ibdids[col]);
-    for(int col = 0; col < n; col++){
-        // Diagonal element
-        int ibdid_col = phi2_indices[col];
-        auto it = phi2_data.find(std::make_pair(ibdid_col, ibdid_col));
-        phi2_array[col * n + col] = (it != phi2_data.end()) ? it->second : 0.0;
-        
-        // Off-diagonal elements (matching original loop structure)
-        for(int row = col + 1; row < n; row++){
-            int ibdid_row = phi2_indices[row];
-            auto it = phi2_data.find(std::make_pair(ibdid_row, ibdid_col));
-            double value = (it != phi2_data.end()) ? it->second : 0.0;
-            phi2_array[col * n + row] = value;
-            phi2_array[row * n + col] = value;
+    std::vector<int> union_indices;
+    for (size_t index = 1; index < union_row.size(); index++) {
+        if (union_row[index] == 0) {
+            union_row[index] = static_cast<int>(union_indices.size());
+            union_indices.push_back(static_cast<int>(index));
         }
     }
-    
-    // Allocate arrays exactly like original SOLAR
-    double* eigenvalues = new double[n];
-    double* eigenvectors = new double[n * n];
-    double* e_work = new double[n];
-    memset(e_work, 0, sizeof(double)*n);  // Zero initialize like original
-    int n_int = static_cast<int>(n);
-    int* info = new int;
-    *info = 0;
-    
-    // Call FORTRAN symeig routine exactly like original
-    symeig_(&n_int, phi2_array, eigenvalues, e_work, eigenvectors, info);
-    
-    if (*info != 0) {
-        CERR << "Error: FORTRAN eigenvalue decomposition failed with code " << *info << std::endl;
-        delete[] phi2_array;
-        delete[] eigenvalues;
-        delete[] eigenvectors;
-        delete[] e_work;
-        delete info;
-        return 1;
-    }
-    
-    // Clean up work arrays
-    delete[] phi2_array;
-    delete[] e_work;
-    delete info;
-    
-    // Write eigenvalues file using computed values
-    std::string eigenvals_filename = std::string(output_basename) + ".eigenvalues";
-    std::ofstream eigenvals_file(eigenvals_filename);
-    if (!eigenvals_file) {
-        CERR << "Error: Cannot create eigenvalues file" << std::endl;
-        return 1;
-    }
-    
-    for (int i = 0; i < n; i++) {  // TQL2 produces ascending order
-        if (i > 0) eigenvals_file << " ";
-        eigenvals_file << eigenvalues[i];
-    }
-    eigenvals_file.close();
-    
-    // Write eigenvectors file using computed values
-    std::string eigenvecs_filename = std::string(output_basename) + ".eigenvectors";
-    std::ofstream eigenvecs_file(eigenvecs_filename);
-    if (!eigenvecs_file) {
-        CERR << "Error: Cannot create eigenvectors file" << std::endl;
+
+    KinshipMatrix phi2;
+    if (KinshipMatrix::load(phi2_path_for(output_basename), union_indices, phi2) != 0) {
         return 1;
     }
-    
-    // Write eigenvectors in column-major order (same order as eigenvalues)
-    // FORTRAN stores in column-major, so we read column by column
-    for (int col = 0; col < n; col++) {
-        for (int row = 0; row < n; row++) {
-            eigenvecs_file << eigenvectors[col * n + row] << " ";
+
+    // Largest sets first; each set's blocks run serially on its worker
+    std::vector<size_t> order(n_sets);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return subject_sets[a].size() > subject_sets[b].size();
+    });
+
+    evds.assign(n_sets, Evd());
+    std::atomic<bool> failed(false);
+    parallel_for(n_sets, [&](size_t k) {
+        size_t set = order[k];
+        std::vector<int> rows;
+        rows.reserve(set_indices[set].size());
+        for (int index : set_indices[set]) {
+            rows.push_back(union_row[index]);
         }
-    }
-    eigenvecs_file.close();
-    
-    // Clean up remaining arrays
-    delete[] eigenvalues;
-    delete[] eigenvectors;
+        KinshipMatrix set_phi2;
+        phi2.subset(rows, set_phi2);
+        if (decompose_phi2(pedigree, set_phi2, set_indices[set], subject_sets[set], options, evds[set]) != 0) {
+            failed = true;
+        }
+    });
 
-    return 0;
+    return failed ? 1 : 0;
 }
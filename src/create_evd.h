@@ -1,26 +1,109 @@
 #ifndef CREATE_EVD_H
 #define CREATE_EVD_H
 
+#include <cstddef>
 #include <vector>
 #include <string>
 
+#include "eigen_solver.h"
+
 // Forward declarations
 class Pedigree;
 class Phenotypes;
+class Evd;
+
+// Options controlling how the phi2 matrix is decomposed
+struct EvdOptions {
+    // Decompose each family (connected block of phi2) separately instead of
+    // the whole n x n matrix; eigenvectors stay in block-sparse form
+    bool block_diagonal = false;
+
+    // Eigensolver used for every block
+    EigenSolverBackend solver = EigenSolverBackend::Auto;
+
+    // Also write <basename>.ids, .notes and .evd; the decomposition is
+    // always returned in memory
+    bool write_files = true;
+
+    // A session derives the EVD of a subject set from a cached EVD of a
+    // superset by removing subjects (EvdDowndate) while the estimated cost
+    // is below this fraction of a new decomposition; 0 (the default)
+    // disables downdates, so every EVD is a fresh decomposition
+    double downdate_crossover = 0.0;
+
+    // Approximate a dense EVD by its leading eigenpairs (RandomizedEvd),
+    // fitting the rest as one eigenvalue group: truncated_rank components,
+    // or with truncated_rank 0, as many as it takes for the rest to spread
+    // less than truncated_tolerance about their mean (relative RMS). Both 0
+    // decompose exactly; block-diagonal EVDs are always exact
+    size_t truncated_rank = 0;
+    double truncated_tolerance = 0.0;
+
+    bool is_truncated() const {
+        return !block_diagonal && (truncated_rank > 0 || truncated_tolerance > 0.0);
+    }
+};
 
 // Simplified EVD data creation for the standalone implementation
 class CreateEVD {
 public:
-    // Create EVD data files with explicit parameters (no globals)
+    // Create EVD data with explicit parameters (no globals); the result is
+    // stored in evd and written to files when options.write_files is set
     static int create_evd_data(
-        Pedigree* pedigree,
+        const Pedigree* pedigree,
         Phenotypes* phenotypes,
         const std::string& trait_name,
+        const char* output_basename,
+        Evd& evd,
+        const EvdOptions& options = EvdOptions()
+    );
+
+    // Create EVD data for the IDs that have every listed trait
+    // (one decomposition shared by a batch of traits)
+    static int create_evd_data(
+        const Pedigree* pedigree,
+        Phenotypes* phenotypes,
+        const std::vector<std::string>& trait_names,
+        const char* output_basename,
+        Evd& evd,
+        const EvdOptions& options = EvdOptions()
+    );
+
+    // IDs, in pedigree order, that have a value for every listed trait;
+    // these are the rows of the EVD create_evd_data builds for the traits
+    static int select_subjects(
+        const Pedigree* pedigree,
+        const Phenotypes* phenotypes,
+        const std::vector<std::string>& trait_names,
+        std::vector<std::string>& valid_ids
+    );
+
+    // Write the .ids, .notes and .evd files create_evd_data would write
+    // for an existing decomposition of the same subjects
+    static int write_evd_files(
+        const Phenotypes* phenotypes,
+        const std::vector<std::string>& trait_names,
+        const Evd& evd,
         const char* output_basename
     );
 
     // Compute eigenvalue decomposition of phi2 matrix
-    static int compute_eigen_decomposition(const std::vector<std::string>& valid_ids, const char* output_basename);
+    // (valid_ids are looked up in the pedigree's ID dictionary)
+    static int compute_eigen_decomposition(const Pedigree* pedigree,
+                                           const std::vector<std::string>& valid_ids,
+                                           const char* output_basename,
+                                           Evd& evd,
+                                           const EvdOptions& options = EvdOptions());
+
+    // Decompose phi2 for several subject sets at once (e.g. one per trait
+    // missingness pattern): phi2.gz is read once for the union of the
+    // sets and the sets are decomposed in parallel. evds[k] receives the
+    // decomposition of subject_sets[k]; no files are written
+    static int compute_eigen_decompositions(const Pedigree* pedigree,
+                                            const std::vector<std::vector<std::string>>& subject_sets,
+                                            const char* output_basename,
+                                            std::vector<Evd>& evds,
+                                            const EvdOptions& options = EvdOptions());
 
     // Show help for create_evd_data command
     static void show_help();
@@ -1,47 +1,105 @@
-#include <sstream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "csv_reader.h"
+#include "mapped_file.h"
+
+// Next ',' or '\n' in [p, end), or end; 16 bytes per step with SSE2
+static const char* find_delimiter(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma),
+                                                  _mm_cmpeq_epi8(chunk, newline)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != ',' && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+// Remove leading/trailing whitespace
+static std::string_view trim(std::string_view field) {
+    const char* whitespace = " \n\r\t";
+    size_t first = field.find_first_not_of(whitespace);
+    if (first == std::string_view::npos) {
+        return std::string_view();
+    }
+    size_t last = field.find_last_not_of(whitespace);
+    return field.substr(first, last - first + 1);
+}
 
 CSVReader::CSVReader(const std::string& filename) {
-    file.open(filename);
+    mapping = MappedFile::open(filename);
+    if (mapping) {
+        pos = mapping->data();
+        end = pos + mapping->size();
+    }
+}
+
+CSVReader::CSVReader(const char* begin, const char* end)
+    : pos(begin), end(end) {
 }
 
 CSVReader::~CSVReader() {
-    if (file.is_open()) {
-        file.close();
+}
+
+bool CSVReader::get_record(std::vector<std::string_view>& record) {
+    record.clear();
+    if (pos >= end) {
+        return false;
+    }
+
+    // An empty line is a record with no fields
+    if (*pos == '\n') {
+        pos++;
+        return true;
+    }
+
+    const char* field_start = pos;
+    for (;;) {
+        const char* delimiter = find_delimiter(field_start, end);
+        bool end_of_line = (delimiter == end || *delimiter == '\n');
+
+        // Like std::getline(..., ','), a final ',' does not start a new field
+        if (!(end_of_line && delimiter == field_start && field_start != pos)) {
+            record.push_back(trim(std::string_view(field_start, delimiter - field_start)));
+        }
+
+        if (end_of_line) {
+            pos = (delimiter == end) ? end : delimiter + 1;
+            return true;
+        }
+        field_start = delimiter + 1;
     }
 }
 
 bool CSVReader::get_header(std::vector<std::string>& header) {
-    if (!file.is_open() || !std::getline(file, line)) {
+    std::vector<std::string_view> fields;
+    if (!get_record(fields)) {
         return false;
     }
 
-    std::stringstream ss(line);
-    std::string field;
-    while (std::getline(ss, field, ',')) {
-        // Remove leading/trailing whitespace
-        field.erase(field.find_last_not_of(" \n\r\t")+1);
-        field.erase(0, field.find_first_not_of(" \n\r\t"));
-        header.push_back(field);
+    for (std::string_view field : fields) {
+        header.emplace_back(field);
     }
     return true;
 }
 
 bool CSVReader::get_record(std::vector<std::string>& record) {
-    if (!file.is_open() || !std::getline(file, line)) {
+    std::vector<std::string_view> fields;
+    if (!get_record(fields)) {
         return false;
     }
 
-    std::stringstream ss(line);
-    std::string field;
-    record.clear();
-    while (std::getline(ss, field, ',')) {
-        // Remove leading/trailing whitespace
-        field.erase(field.find_last_not_of(" \n\r\t")+1);
-        field.erase(0, field.find_first_not_of(" \n\r\t"));
-        record.push_back(field);
-    }
+    record.assign(fields.begin(), fields.end());
     return true;
 }
-
@@ -1,22 +1,42 @@
-
 #ifndef CSV_READER_H
 #define CSV_READER_H
 
+#include <memory>
 #include <vector>
 #include <string>
-#include <fstream>
+#include <string_view>
+
+class MappedFile;
 
+// Comma-separated reader over a memory-mapped file. Fields are split on ','
+// and trimmed of surrounding whitespace; a trailing empty field after a
+// final ',' is dropped.
 class CSVReader {
 public:
     CSVReader(const std::string& filename);
+
+    // Tokenize [begin, end) owned by the caller (e.g. one line-aligned
+    // chunk of another reader's remaining() range)
+    CSVReader(const char* begin, const char* end);
+
     ~CSVReader();
 
+    bool is_open() const { return mapping != nullptr; }
+
+    // Bytes not yet consumed by get_header/get_record
+    std::string_view remaining() const { return std::string_view(pos, end - pos); }
+
     bool get_header(std::vector<std::string>& header);
     bool get_record(std::vector<std::string>& record);
 
+    // Zero-copy variant: fields point into the mapped file and stay valid
+    // for the lifetime of the reader
+    bool get_record(std::vector<std::string_view>& record);
+
 private:
-    std::ifstream file;
-    std::string line;
+    std::shared_ptr<MappedFile> mapping;
+    const char* pos = nullptr;
+    const char* end = nullptr;
 };
 
 #endif
@@ -0,0 +1,192 @@
+/*
+ * eigen_solver.cc - Symmetric eigensolver backends
+ */
+
+#define USE_FC_LEN_T
+#include <Rcpp.h>
+#include <R_ext/Lapack.h>
+#ifndef FCONE
+#define FCONE
+#endif
+
+#include <climits>
+#include <string>
+
+#include "Eigen/Dense"
+#include "eigen_solver.h"
+#include "log_sink.h"
+
+// FORTRAN eigenvalue decomposition routine
+extern "C" void symeig_(int* n, double* a, double* d, double* e, double* z, int* info);
+
+static int decompose_eispack(int n, std::vector<double>& matrix,
+                             std::vector<double>& values, std::vector<double>& vectors) {
+    // TQL2 produces ascending order
+    std::vector<double> e_work(n, 0.0);
+    int info = 0;
+    vectors.assign(static_cast<size_t>(n) * n, 0.0);
+    symeig_(&n, matrix.data(), values.data(), e_work.data(), vectors.data(), &info);
+    return info;
+}
+
+static int decompose_eigen(int n, std::vector<double>& matrix,
+                           std::vector<double>& values, std::vector<double>& vectors) {
+    Eigen::Map<const Eigen::MatrixXd> a(matrix.data(), n, n);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(a, Eigen::ComputeEigenvectors);
+    if (solver.info() != Eigen::Success) {
+        return 1;
+    }
+    Eigen::Map<Eigen::VectorXd>(values.data(), n) = solver.eigenvalues();
+    vectors.resize(static_cast<size_t>(n) * n);
+    Eigen::Map<Eigen::MatrixXd>(vectors.data(), n, n) = solver.eigenvectors();
+    return 0;
+}
+
+// LAPACK takes workspace lengths as int: dsyevd needs 1 + 6n + 2n^2
+// doubles, which passes INT_MAX from n = 32767 (its own LWMIN overflows
+// in the query), so it is checked in double precision before calling it
+static bool dsyevd_workspace_fits(int n) {
+    return 2.0 * n * n + 6.0 * n + 1.0 <= static_cast<double>(INT_MAX);
+}
+
+// Workspace length from a LAPACK query, or 1 if it does not fit an int
+static int workspace_length(const char* routine, int n, double work_size, int& lwork) {
+    if (work_size > static_cast<double>(INT_MAX)) {
+        LogSink::error(std::string("Error: ") + routine + " workspace for a " + std::to_string(n) +
+                       "-subject matrix exceeds the LAPACK integer range");
+        return 1;
+    }
+    lwork = static_cast<int>(work_size);
+    return 0;
+}
+
+static int decompose_dsyevd(int n, std::vector<double>& matrix,
+                            std::vector<double>& values, std::vector<double>& vectors) {
+    const char jobz = 'V';
+    const char uplo = 'L';
+    int info = 0;
+
+    if (!dsyevd_workspace_fits(n)) {
+        LogSink::error("Error: dsyevd workspace for a " + std::to_string(n) +
+                       "-subject matrix exceeds the LAPACK integer range; use dsyevr or eispack");
+        return 1;
+    }
+
+    // Workspace query
+    int lwork = -1;
+    int liwork = -1;
+    double work_size = 0.0;
+    int iwork_size = 0;
+    F77_CALL(dsyevd)(&jobz, &uplo, &n, matrix.data(), &n, values.data(),
+                     &work_size, &lwork, &iwork_size, &liwork, &info FCONE FCONE);
+    if (info != 0) {
+        return info;
+    }
+
+    if (workspace_length("dsyevd", n, work_size, lwork) != 0) {
+        return 1;
+    }
+    liwork = iwork_size;
+    std::vector<double> work(lwork);
+    std::vector<int> iwork(liwork);
+    F77_CALL(dsyevd)(&jobz, &uplo, &n, matrix.data(), &n, values.data(),
+                     work.data(), &lwork, iwork.data(), &liwork, &info FCONE FCONE);
+
+    // dsyevd leaves the eigenvectors in place of the matrix
+    vectors.swap(matrix);
+    return info;
+}
+
+static int decompose_dsyevr(int n, std::vector<double>& matrix,
+                            std::vector<double>& values, std::vector<double>& vectors) {
+    const char jobz = 'V';
+    const char range = 'A';
+    const char uplo = 'L';
+    const double vl = 0.0;
+    const double vu = 0.0;
+    const int il = 0;
+    const int iu = 0;
+    const double abstol = 0.0;
+    int m = 0;
+    int info = 0;
+    std::vector<int> isuppz(2 * static_cast<size_t>(n));
+    vectors.resize(static_cast<size_t>(n) * n);
+
+    // Workspace query
+    int lwork = -1;
+    int liwork = -1;
+    double work_size = 0.0;
+    int iwork_size = 0;
+    F77_CALL(dsyevr)(&jobz, &range, &uplo, &n, matrix.data(), &n, &vl, &vu, &il, &iu,
+                     &abstol, &m, values.data(), vectors.data(), &n, isuppz.data(),
+                     &work_size, &lwork, &iwork_size, &liwork, &info FCONE FCONE FCONE);
+    if (info != 0) {
+        return info;
+    }
+
+    // 26n doubles, within an int up to n of about 82 million
+    if (workspace_length("dsyevr", n, work_size, lwork) != 0) {
+        return 1;
+    }
+    liwork = iwork_size;
+    std::vector<double> work(lwork);
+    std::vector<int> iwork(liwork);
+    F77_CALL(dsyevr)(&jobz, &range, &uplo, &n, matrix.data(), &n, &vl, &vu, &il, &iu,
+                     &abstol, &m, values.data(), vectors.data(), &n, isuppz.data(),
+                     work.data(), &lwork, iwork.data(), &liwork, &info FCONE FCONE FCONE);
+    if (info == 0 && m != n) {
+        return 1;
+    }
+    return info;
+}
+
+EigenSolverBackend EigenSolver::resolve(EigenSolverBackend backend, int n) {
+    if (backend != EigenSolverBackend::Auto) {
+        return backend;
+    }
+    return dsyevd_workspace_fits(n) ? EigenSolverBackend::Dsyevd : EigenSolverBackend::Dsyevr;
+}
+
+const char* EigenSolver::name(EigenSolverBackend backend) {
+    switch (backend) {
+        case EigenSolverBackend::Auto: return "auto";
+        case EigenSolverBackend::Eispack: return "eispack";
+        case EigenSolverBackend::Eigen: return "eigen";
+        case EigenSolverBackend::Dsyevd: return "dsyevd";
+        case EigenSolverBackend::Dsyevr: return "dsyevr";
+    }
+    return "unknown";
+}
+
+int EigenSolver::parse(const std::string& name, EigenSolverBackend& backend) {
+    const EigenSolverBackend all[] = {
+        EigenSolverBackend::Auto, EigenSolverBackend::Eispack, EigenSolverBackend::Eigen,
+        EigenSolverBackend::Dsyevd, EigenSolverBackend::Dsyevr
+    };
+    for (EigenSolverBackend candidate : all) {
+        if (name == EigenSolver::name(candidate)) {
+            backend = candidate;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int EigenSolver::decompose(EigenSolverBackend backend, int n,
+                           std::vector<double>& matrix,
+                           std::vector<double>& values,
+                           std::vector<double>& vectors) {
+    values.assign(n, 0.0);
+
+    switch (resolve(backend, n)) {
+        case EigenSolverBackend::Eispack:
+            return decompose_eispack(n, matrix, values, vectors);
+        case EigenSolverBackend::Eigen:
+            return decompose_eigen(n, matrix, values, vectors);
+        case EigenSolverBackend::Dsyevr:
+            return decompose_dsyevr(n, matrix, values, vectors);
+        case EigenSolverBackend::Dsyevd:
+        default:
+            return decompose_dsyevd(n, matrix, values, vectors);
+    }
+}
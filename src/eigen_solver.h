@@ -0,0 +1,44 @@
+/*
+ * eigen_solver.h - Symmetric eigensolver backends for the phi2 EVD
+ * Wraps the original EISPACK TRED2/TQL2 routine (symeig.f), Eigen's
+ * SelfAdjointEigenSolver and R's LAPACK dsyevd/dsyevr behind one call
+ */
+
+#ifndef EIGEN_SOLVER_H
+#define EIGEN_SOLVER_H
+
+#include <string>
+#include <vector>
+
+enum class EigenSolverBackend {
+    Auto,     // Fastest available (dsyevd, dsyevr past dsyevd's workspace limit)
+    Eispack,  // symeig.f, serial TRED2/TQL2 as in the original SOLAR
+    Eigen,    // Bundled Eigen SelfAdjointEigenSolver
+    Dsyevd,   // LAPACK divide and conquer (uses R's BLAS, threaded if R's is)
+    Dsyevr    // LAPACK relatively robust representations
+};
+
+class EigenSolver {
+public:
+    // Map Auto to a concrete backend for an n x n matrix: dsyevd, or
+    // dsyevr from n = 32767, where dsyevd's workspace no longer fits an int
+    static EigenSolverBackend resolve(EigenSolverBackend backend, int n = 0);
+
+    // Backend name as accepted by parse()
+    static const char* name(EigenSolverBackend backend);
+
+    // Parse "auto", "eispack", "eigen", "dsyevd" or "dsyevr"
+    // Returns 0 on success, 1 for an unknown name
+    static int parse(const std::string& name, EigenSolverBackend& backend);
+
+    // Decompose the symmetric n x n column-major matrix (overwritten).
+    // values receives the eigenvalues in ascending order and vectors the
+    // matching eigenvectors, column-major.
+    // Returns 0 on success, otherwise the backend's error code
+    static int decompose(EigenSolverBackend backend, int n,
+                         std::vector<double>& matrix,
+                         std::vector<double>& values,
+                         std::vector<double>& vectors);
+};
+
+#endif // EIGEN_SOLVER_H
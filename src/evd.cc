@@ -0,0 +1,76 @@
+/*
+ * evd.cc - Block-diagonal eigendecomposition container
+ */
+
+#include <algorithm>
+
+#include "evd.h"
+
+size_t Evd::num_components() const {
+    size_t count = 0;
+    for (const auto& block : blocks) {
+        count += block.num_components();
+    }
+    return count;
+}
+
+bool Evd::is_complete() const {
+    for (const auto& block : blocks) {
+        if (block.num_components() != block.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<double> Evd::eigenvalues() const {
+    std::vector<double> values;
+    values.reserve(num_components());
+    for (const auto& block : blocks) {
+        values.insert(values.end(), block.values.begin(), block.values.end());
+    }
+    return values;
+}
+
+void Evd::dense_vectors(double* out) const {
+    size_t n = num_subjects();
+    std::fill(out, out + n * num_components(), 0.0);
+
+    size_t offset = 0;
+    for (const auto& block : blocks) {
+        const double* vectors = block.vector_data();
+        for (size_t c = 0; c < block.num_components(); c++) {
+            double* column = out + (offset + c) * n;
+            for (size_t i = 0; i < block.size(); i++) {
+                column[block.rows[i]] = vectors[c * block.size() + i];
+            }
+        }
+        offset += block.num_components();
+    }
+}
+
+Eigen::MatrixXd Evd::project(const Eigen::MatrixXd& traits) const {
+    Eigen::MatrixXd projected(num_components(), traits.cols());
+
+    size_t offset = 0;
+    for (const auto& block : blocks) {
+        Eigen::Map<const Eigen::MatrixXd> vectors(block.vector_data(), block.size(), block.num_components());
+
+        if (is_dense()) {
+            // Single block in subject order: no gather needed
+            projected.middleRows(offset, block.num_components()).noalias() = vectors.transpose() * traits;
+        } else if (block.size() == 1) {
+            // Singleton family: 1 x 1 eigenvector
+            projected.row(offset) = vectors(0, 0) * traits.row(block.rows[0]);
+        } else {
+            Eigen::MatrixXd gathered(block.size(), traits.cols());
+            for (size_t i = 0; i < block.size(); i++) {
+                gathered.row(i) = traits.row(block.rows[i]);
+            }
+            projected.middleRows(offset, block.num_components()).noalias() = vectors.transpose() * gathered;
+        }
+        offset += block.num_components();
+    }
+
+    return projected;
+}
@@ -0,0 +1,65 @@
+/*
+ * evd.h - Eigendecomposition of the phi2 (kinship) matrix
+ * Holds the decomposition in block-diagonal form: a dense EVD is a single
+ * block covering every subject, while a block-diagonal EVD keeps one small
+ * dense block per family so eigenvectors never need n x n storage.
+ * A low-rank EVD stores fewer components than subjects; the rest span the
+ * orthogonal complement of the stored eigenvectors and share one
+ * eigenvalue (remainder_value), so they are never formed
+ */
+
+#ifndef EVD_H
+#define EVD_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+
+class MappedFile;
+
+// One diagonal block of the decomposition
+struct EvdBlock {
+    std::vector<int> rows;        // Subject rows (indices into Evd::ids) in this block
+    std::vector<double> values;   // Eigenvalues of the block
+    std::vector<double> vectors;  // rows.size() x values.size(), column-major
+    const double* mapped_vectors = nullptr;  // Used instead of vectors when read from a .evd file
+
+    size_t size() const { return rows.size(); }
+    size_t num_components() const { return values.size(); }
+    const double* vector_data() const { return mapped_vectors ? mapped_vectors : vectors.data(); }
+};
+
+class Evd {
+public:
+    std::vector<std::string> ids;  // Subject IDs in row order
+    std::vector<EvdBlock> blocks;
+    std::shared_ptr<const MappedFile> mapping;  // Keeps mapped eigenvectors alive
+    double remainder_value = 0.0;  // Eigenvalue of the components not stored
+
+    size_t num_subjects() const { return ids.size(); }
+    size_t num_components() const;
+
+    // Components not stored (0 for a full decomposition)
+    size_t num_remainder() const { return num_subjects() - num_components(); }
+
+    // Every block carries all of its eigenvectors, as an EvdDowndate needs
+    // (false for a truncated or low-rank EVD)
+    bool is_complete() const;
+    bool is_dense() const { return blocks.size() == 1 && blocks[0].size() == ids.size(); }
+
+    // Eigenvalues in component order (blocks concatenated)
+    std::vector<double> eigenvalues() const;
+
+    // Eigenvectors as a num_subjects x num_components column-major matrix
+    // (blocks expanded with zeros) written to out
+    void dense_vectors(double* out) const;
+
+    // U^T * traits, where traits is num_subjects x k in subject row order;
+    // returns num_components x k in component order
+    Eigen::MatrixXd project(const Eigen::MatrixXd& traits) const;
+};
+
+#endif // EVD_H
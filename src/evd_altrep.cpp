@@ -0,0 +1,160 @@
+/*
+ * evd_altrep.cpp - ALTREP class for zero-copy eigenvector matrices
+ */
+
+#include <Rcpp.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <Rversion.h>
+#if R_VERSION < R_Version(3, 6, 0)
+// R 3.5's Altrep.h uses "class" as a parameter name
+#define class klass
+extern "C" {
+#include <R_ext/Altrep.h>
+}
+#undef class
+#else
+#include <R_ext/Altrep.h>
+#endif
+
+#include "evd_altrep.h"
+#include "evd.h"
+
+namespace {
+    R_altrep_class_t evd_vectors_class;
+
+    // data1 of a view: the EVD plus the maps needed to find element (i, j)
+    // of the expanded matrix inside its block
+    struct EvdView {
+        std::shared_ptr<const Evd> evd;
+        size_t n_subjects = 0;
+        size_t n_components = 0;
+        std::vector<int> row_block;        // subject row -> block
+        std::vector<int> row_position;     // subject row -> row within its block
+        std::vector<int> component_block;  // component -> block
+        std::vector<size_t> first_component;  // block -> first component
+
+        double value(size_t row, size_t component) const {
+            int b = component_block[component];
+            if (row_block[row] != b) {
+                return 0.0;
+            }
+            const EvdBlock& block = evd->blocks[b];
+            return block.vector_data()[(component - first_component[b]) * block.size() + row_position[row]];
+        }
+    };
+
+    EvdView* get_view(SEXP x) {
+        return static_cast<EvdView*>(R_ExternalPtrAddr(R_altrep_data1(x)));
+    }
+
+    // Expanded copy made the first time R needs a data pointer it can't
+    // be given directly (block-diagonal EVD, or a writeable pointer)
+    SEXP materialize(SEXP x) {
+        SEXP data = R_altrep_data2(x);
+        if (data == R_NilValue) {
+            const EvdView* view = get_view(x);
+            data = PROTECT(Rf_allocVector(REALSXP, view->n_subjects * view->n_components));
+            view->evd->dense_vectors(REAL(data));
+            R_set_altrep_data2(x, data);
+            UNPROTECT(1);
+        }
+        return data;
+    }
+
+    R_xlen_t vectors_length(SEXP x) {
+        const EvdView* view = get_view(x);
+        return static_cast<R_xlen_t>(view->n_subjects * view->n_components);
+    }
+
+    Rboolean vectors_inspect(SEXP x, int, int, int, void (*)(SEXP, int, int, int)) {
+        const EvdView* view = get_view(x);
+        Rprintf(" solar_evd_vectors %zu x %zu, %zu block(s)%s\n", view->n_subjects, view->n_components,
+                view->evd->blocks.size(), R_altrep_data2(x) != R_NilValue ? ", materialized" : "");
+        return TRUE;
+    }
+
+    const void* vectors_dataptr_or_null(SEXP x) {
+        SEXP data = R_altrep_data2(x);
+        if (data != R_NilValue) {
+            return REAL(data);
+        }
+        const EvdView* view = get_view(x);
+        if (view->evd->is_dense()) {
+            return view->evd->blocks[0].vector_data();
+        }
+        return nullptr;
+    }
+
+    void* vectors_dataptr(SEXP x, Rboolean writeable) {
+        // The C++ buffer and the mapping are shared, so writes go to a copy
+        if (!writeable && R_altrep_data2(x) == R_NilValue && get_view(x)->evd->is_dense()) {
+            return const_cast<double*>(get_view(x)->evd->blocks[0].vector_data());
+        }
+        return REAL(materialize(x));
+    }
+
+    double vectors_elt(SEXP x, R_xlen_t i) {
+        SEXP data = R_altrep_data2(x);
+        if (data != R_NilValue) {
+            return REAL(data)[i];
+        }
+        const EvdView* view = get_view(x);
+        return view->value(i % view->n_subjects, i / view->n_subjects);
+    }
+
+    R_xlen_t vectors_get_region(SEXP x, R_xlen_t start, R_xlen_t size, double* buf) {
+        R_xlen_t count = std::min(size, vectors_length(x) - start);
+        const double* data = static_cast<const double*>(vectors_dataptr_or_null(x));
+        if (data) {
+            std::copy(data + start, data + start + count, buf);
+            return count;
+        }
+        const EvdView* view = get_view(x);
+        for (R_xlen_t k = 0; k < count; k++) {
+            R_xlen_t i = start + k;
+            buf[k] = view->value(i % view->n_subjects, i / view->n_subjects);
+        }
+        return count;
+    }
+}
+
+// [[Rcpp::init]]
+void init_evd_altrep(DllInfo* dll) {
+    evd_vectors_class = R_make_altreal_class("solar_evd_vectors", "solareclipser", dll);
+    R_set_altrep_Length_method(evd_vectors_class, vectors_length);
+    R_set_altrep_Inspect_method(evd_vectors_class, vectors_inspect);
+    R_set_altvec_Dataptr_method(evd_vectors_class, vectors_dataptr);
+    R_set_altvec_Dataptr_or_null_method(evd_vectors_class, vectors_dataptr_or_null);
+    R_set_altreal_Elt_method(evd_vectors_class, vectors_elt);
+    R_set_altreal_Get_region_method(evd_vectors_class, vectors_get_region);
+}
+
+SEXP make_evd_vectors_view(std::shared_ptr<const Evd> evd) {
+    Rcpp::XPtr<EvdView> view(new EvdView, true);
+    view->n_subjects = evd->num_subjects();
+    view->n_components = evd->num_components();
+    view->row_block.assign(view->n_subjects, -1);
+    view->row_position.assign(view->n_subjects, 0);
+    view->component_block.reserve(view->n_components);
+
+    size_t offset = 0;
+    for (size_t b = 0; b < evd->blocks.size(); b++) {
+        const EvdBlock& block = evd->blocks[b];
+        for (size_t i = 0; i < block.size(); i++) {
+            view->row_block[block.rows[i]] = static_cast<int>(b);
+            view->row_position[block.rows[i]] = static_cast<int>(i);
+        }
+        view->first_component.push_back(offset);
+        view->component_block.insert(view->component_block.end(), block.num_components(), static_cast<int>(b));
+        offset += block.num_components();
+    }
+    view->evd = std::move(evd);
+
+    Rcpp::RObject vectors = R_new_altrep(evd_vectors_class, view, R_NilValue);
+    vectors.attr("dim") = Rcpp::IntegerVector::create(static_cast<int>(view->n_subjects),
+                                                      static_cast<int>(view->n_components));
+    return vectors;
+}
@@ -0,0 +1,28 @@
+/*
+ * evd_altrep.h - Eigenvectors exposed to R without copying
+ *
+ * Eigenvectors are wrapped in an ALTREP real vector (class
+ * "solar_evd_vectors") with a subjects x components dim attribute. A dense
+ * EVD hands R a pointer straight into the C++ buffer or .evd mapping;
+ * a block-diagonal EVD is read element by element (zeros outside each
+ * family's block) and only expanded if R asks for a data pointer.
+ */
+
+#ifndef EVD_ALTREP_H
+#define EVD_ALTREP_H
+
+#include <memory>
+
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+
+class Evd;
+
+// Register the ALTREP class; called from R_init_solareclipser
+void init_evd_altrep(DllInfo* dll);
+
+// Eigenvector matrix of evd as an ALTREP numeric matrix; the view keeps
+// evd (and any mapping behind it) alive
+SEXP make_evd_vectors_view(std::shared_ptr<const Evd> evd);
+
+#endif // EVD_ALTREP_H
@@ -0,0 +1,330 @@
+/*
+ * evd_cache.cc - Content-addressed cache of phi2 decompositions
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <zlib.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <Rcpp.h>
+#define COUT Rcpp::Rcout
+#define CERR Rcpp::Rcerr
+
+#include "evd_cache.h"
+#include "create_evd.h"
+#include "eigen_solver.h"
+#include "evd.h"
+#include "evd_file.h"
+#include "mapped_file.h"
+#include "pedigree_loader.h"
+
+// 64-bit FNV-1a, for keys over short inputs
+class KeyHash {
+public:
+    void add(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash_ = (hash_ ^ bytes[i]) * 1099511628211ULL;
+        }
+    }
+
+    void add_string(const std::string& text) {
+        uint64_t length = text.size();
+        add(&length, sizeof(length));
+        add(text.data(), text.size());
+    }
+
+    uint64_t value() const { return hash_; }
+
+private:
+    uint64_t hash_ = 14695981039346656037ULL;
+};
+
+// zlib's crc32 takes 32-bit lengths, so feed large buffers in pieces
+static uLong update_crc(uLong crc, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    const size_t max_chunk = 1u << 30;
+    while (size > 0) {
+        size_t chunk = size < max_chunk ? size : max_chunk;
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(bytes), static_cast<uInt>(chunk));
+        bytes += chunk;
+        size -= chunk;
+    }
+    return crc;
+}
+
+static std::string entry_path(const std::string& directory, const std::string& key) {
+    return directory + "/" + key + ".evd";
+}
+
+// mkdir -p; returns 0 when the directory exists afterwards
+static int make_directories(const std::string& path) {
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string prefix = path.substr(0, slash);
+#ifdef _WIN32
+        int rc = _mkdir(prefix.c_str());
+#else
+        int rc = mkdir(prefix.c_str(), 0777);
+#endif
+        if (rc != 0 && errno != EEXIST) {
+            return 1;
+        }
+        if (slash == std::string::npos) {
+            return 0;
+        }
+    }
+}
+
+// Delete the least recently used .evd files until the directory is within limit
+static void trim_directory(const std::string& directory, uint64_t limit) {
+    struct CacheFile {
+        std::string path;
+        uint64_t size;
+        time_t mtime;
+    };
+    std::vector<CacheFile> files;
+    uint64_t total = 0;
+
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".evd") != 0) {
+            continue;
+        }
+        std::string path = directory + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0) {
+            files.push_back(CacheFile{path, static_cast<uint64_t>(st.st_size), st.st_mtime});
+            total += st.st_size;
+        }
+    }
+    closedir(dir);
+
+    std::sort(files.begin(), files.end(),
+              [](const CacheFile& a, const CacheFile& b) { return a.mtime < b.mtime; });
+    for (const auto& file : files) {
+        if (total <= limit) {
+            break;
+        }
+        if (std::remove(file.path.c_str()) == 0) {
+            total -= file.size;
+        }
+    }
+}
+
+int EvdCache::file_fingerprint(const std::string& path, uint64_t& fingerprint) {
+    auto file = MappedFile::open(path);
+    if (!file) {
+        return 1;
+    }
+    uLong crc = update_crc(crc32(0L, Z_NULL, 0), file->data(), file->size());
+    fingerprint = (static_cast<uint64_t>(file->size()) << 32) ^ crc;
+    return 0;
+}
+
+uint64_t EvdCache::table_fingerprint(const KinshipTable& table) {
+    KeyHash hash;
+    for (size_t i = 0; i < table.ida.size(); i++) {
+        hash.add(table.ida[i].data(), table.ida[i].size());
+        hash.add("", 1);
+        hash.add(table.idb[i].data(), table.idb[i].size());
+        hash.add("", 1);
+        hash.add(&table.kin[i], sizeof(double));
+    }
+    return hash.value();
+}
+
+// Everything a key covers apart from the subjects
+static void add_lineage(KeyHash& hash, uint64_t kinship_fingerprint, double threshold,
+                        const EvdOptions& options) {
+    hash.add(&kinship_fingerprint, sizeof(kinship_fingerprint));
+    hash.add(&threshold, sizeof(threshold));
+    hash.add_string(options.block_diagonal ? "block" : "dense");
+    hash.add_string(EigenSolver::name(EigenSolver::resolve(options.solver)));
+    if (options.is_truncated()) {
+        // Exact keys are unchanged
+        uint64_t rank = options.truncated_rank;
+        hash.add_string("truncated");
+        hash.add(&rank, sizeof(rank));
+        hash.add(&options.truncated_tolerance, sizeof(options.truncated_tolerance));
+    }
+}
+
+static std::string hex_key(uint64_t value) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+    return text;
+}
+
+std::string EvdCache::lineage(uint64_t kinship_fingerprint, double threshold, const EvdOptions& options) {
+    KeyHash hash;
+    add_lineage(hash, kinship_fingerprint, threshold, options);
+    return hex_key(hash.value());
+}
+
+std::string EvdCache::key(const std::vector<std::string>& ids, uint64_t kinship_fingerprint,
+                          double threshold, const EvdOptions& options) {
+    KeyHash hash;
+    add_lineage(hash, kinship_fingerprint, threshold, options);
+    uint64_t n_ids = ids.size();
+    hash.add(&n_ids, sizeof(n_ids));
+    for (const auto& id : ids) {
+        hash.add_string(id);
+    }
+    return hex_key(hash.value());
+}
+
+size_t EvdCache::memory_size(const Evd& evd) {
+    // Mapped eigenvectors count too: they are resident once a fit reads them
+    size_t bytes = 0;
+    for (const auto& id : evd.ids) {
+        bytes += id.size();
+    }
+    for (const auto& block : evd.blocks) {
+        bytes += block.size() * sizeof(int);
+        bytes += block.num_components() * sizeof(double);
+        bytes += block.size() * block.num_components() * sizeof(double);
+    }
+    return bytes;
+}
+
+std::shared_ptr<const Evd> EvdCache::find(const std::string& key, const std::vector<std::string>& ids,
+                                          const std::string& lineage, const EvdCacheOptions& options) {
+    auto indexed = index_.find(key);
+    if (indexed != index_.end()) {
+        auto entry = indexed->second;
+        if (entry->evd->ids == ids) {
+            lru_.splice(lru_.begin(), lru_, entry);
+            return entry->evd;
+        }
+    }
+
+    auto held = live_.find(key);
+    if (held != live_.end()) {
+        std::shared_ptr<const Evd> evd = held->second.evd.lock();
+        if (!evd) {
+            live_.erase(held);
+        } else if (evd->ids == ids) {
+            remember(key, evd, lineage, options);
+            return evd;
+        }
+    }
+
+    if (options.disk_limit == 0) {
+        return nullptr;
+    }
+
+    std::string path = entry_path(options.directory, key);
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return nullptr;
+    }
+
+    // Written by rename, so a file that exists is complete, but another
+    // process may have put it there: the checksum is verified the first
+    // time this session maps that file, and the IDs guard against a key
+    // collision
+    Stamp stamp{static_cast<uint64_t>(st.st_ino), static_cast<uint64_t>(st.st_size)};
+    auto checked = verified_.find(key);
+    bool verify = checked == verified_.end() || !(checked->second == stamp);
+    auto evd = std::make_shared<Evd>();
+    if (EvdFile::read(path, *evd, verify) != 0 || evd->ids != ids) {
+        std::remove(path.c_str());
+        verified_.erase(key);
+        return nullptr;
+    }
+    verified_[key] = stamp;
+    utime(path.c_str(), nullptr);  // Most recently used
+
+    remember(key, evd, lineage, options);
+    return evd;
+}
+
+void EvdCache::insert(const std::string& key, const std::shared_ptr<const Evd>& evd, const std::string& lineage,
+                      const EvdCacheOptions& options) {
+    remember(key, evd, lineage, options);
+
+    if (options.disk_limit == 0) {
+        return;
+    }
+
+    // A decomposition larger than the whole disk budget is never kept
+    if (memory_size(*evd) > options.disk_limit) {
+        trim_directory(options.directory, options.disk_limit);
+        return;
+    }
+
+    if (make_directories(options.directory) != 0) {
+        CERR << "Warning: Cannot create EVD cache directory " << options.directory << std::endl;
+        return;
+    }
+
+    // EvdFile::write renames a complete file into place
+    if (EvdFile::write(*evd, entry_path(options.directory, key)) != 0) {
+        return;
+    }
+
+    trim_directory(options.directory, options.disk_limit);
+}
+
+void EvdCache::trim(const EvdCacheOptions& options) {
+    trim_memory(options);
+    if (options.disk_limit > 0) {
+        trim_directory(options.directory, options.disk_limit);
+    }
+}
+
+void EvdCache::trim_memory(const EvdCacheOptions& options) {
+    while (bytes_ > options.memory_limit && !lru_.empty()) {
+        const Entry& oldest = lru_.back();
+        bytes_ -= oldest.bytes;
+        index_.erase(oldest.key);
+        lru_.pop_back();
+    }
+}
+
+std::vector<std::shared_ptr<const Evd>> EvdCache::in_memory(const std::string& lineage) const {
+    std::vector<std::shared_ptr<const Evd>> evds;
+    for (const auto& held : live_) {
+        std::shared_ptr<const Evd> evd = held.second.evd.lock();
+        if (evd && held.second.lineage == lineage) {
+            evds.push_back(std::move(evd));
+        }
+    }
+    return evds;
+}
+
+void EvdCache::remember(const std::string& key, const std::shared_ptr<const Evd>& evd, const std::string& lineage,
+                        const EvdCacheOptions& options) {
+    for (auto held = live_.begin(); held != live_.end();) {
+        held = held->second.evd.expired() ? live_.erase(held) : std::next(held);
+    }
+    live_[key] = Held{evd, lineage};
+
+    auto indexed = index_.find(key);
+    if (indexed != index_.end()) {
+        bytes_ -= indexed->second->bytes;
+        lru_.erase(indexed->second);
+        index_.erase(indexed);
+    }
+
+    size_t bytes = memory_size(*evd);
+    if (bytes <= options.memory_limit) {
+        lru_.push_front(Entry{key, evd, bytes});
+        index_[key] = lru_.begin();
+        bytes_ += bytes;
+    }
+    trim_memory(options);
+}
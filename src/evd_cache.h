@@ -0,0 +1,114 @@
+/*
+ * evd_cache.h - Content-addressed cache of phi2 decompositions
+ *
+ * Traits with the same non-missing subjects decompose the same phi2
+ * submatrix, so every EVD is stored under a key hashed from the ordered
+ * subject IDs, a fingerprint of the kinship input, the kinship threshold
+ * and the EVD options. Recently used decompositions stay in memory up to a
+ * byte budget (least recently used dropped first). With a disk limit set
+ * they are also written to <directory>/<key>.evd, trimmed oldest first by
+ * modification time, and mapped back in when memory no longer holds them
+ * (their checksum verified the first time each file is mapped).
+ */
+
+#ifndef EVD_CACHE_H
+#define EVD_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Evd;
+struct EvdOptions;
+struct KinshipTable;
+
+struct EvdCacheOptions {
+    // Bytes of decompositions held in memory; 0 keeps only those a
+    // session or R object still holds
+    size_t memory_limit = static_cast<size_t>(1) << 30;
+
+    // Bytes of .evd files kept in directory; 0 disables the disk cache
+    uint64_t disk_limit = 0;
+
+    // Disk cache directory (created on first write)
+    std::string directory;
+};
+
+class EvdCache {
+public:
+    // Fingerprint of a kinship file: CRC-32 of its contents and its size.
+    // Returns 0 on success, 1 if the file cannot be read
+    static int file_fingerprint(const std::string& path, uint64_t& fingerprint);
+
+    // Fingerprint of in-memory kinship rows
+    static uint64_t table_fingerprint(const KinshipTable& table);
+
+    // Key (16 hex digits) of the decomposition of ids
+    static std::string key(const std::vector<std::string>& ids, uint64_t kinship_fingerprint,
+                           double threshold, const EvdOptions& options);
+
+    // What a key covers apart from the subjects: the kinship, threshold
+    // and EVD options. Decompositions of the same lineage differ only in
+    // their subjects
+    static std::string lineage(uint64_t kinship_fingerprint, double threshold, const EvdOptions& options);
+
+    // Bytes counted against the memory budget for evd
+    static size_t memory_size(const Evd& evd);
+
+    // Decomposition stored under key for exactly ids, from memory or else
+    // from disk; nullptr on a miss. lineage is that of the key
+    std::shared_ptr<const Evd> find(const std::string& key, const std::vector<std::string>& ids,
+                                    const std::string& lineage, const EvdCacheOptions& options);
+
+    // Store a new decomposition in memory and, with a disk limit, on disk
+    void insert(const std::string& key, const std::shared_ptr<const Evd>& evd, const std::string& lineage,
+                const EvdCacheOptions& options);
+
+    // Decompositions in memory (or still held elsewhere) of the given
+    // lineage, as bases for an EvdDowndate
+    std::vector<std::shared_ptr<const Evd>> in_memory(const std::string& lineage) const;
+
+    // Drop least recently used decompositions beyond options.memory_limit
+    // and, with a disk limit, .evd files beyond options.disk_limit
+    void trim(const EvdCacheOptions& options);
+
+    size_t memory_used() const { return bytes_; }
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const Evd> evd;
+        size_t bytes;
+    };
+
+    void remember(const std::string& key, const std::shared_ptr<const Evd>& evd, const std::string& lineage,
+                  const EvdCacheOptions& options);
+    void trim_memory(const EvdCacheOptions& options);
+
+    std::list<Entry> lru_;  // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    size_t bytes_ = 0;
+
+    // Every decomposition handed out, so one evicted from the budget is
+    // still found while a session or R object holds it
+    struct Held {
+        std::weak_ptr<const Evd> evd;
+        std::string lineage;
+    };
+    std::unordered_map<std::string, Held> live_;
+
+    // Inode and size of each .evd file whose checksum this cache has
+    // verified; a file replaced since then is verified again
+    struct Stamp {
+        uint64_t inode;
+        uint64_t size;
+        bool operator==(const Stamp& other) const { return inode == other.inode && size == other.size; }
+    };
+    std::unordered_map<std::string, Stamp> verified_;
+};
+
+#endif // EVD_CACHE_H
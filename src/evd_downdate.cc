@@ -0,0 +1,319 @@
+/*
+ * evd_downdate.cc - Remove subjects from an existing phi2 decomposition
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include <Rcpp.h>
+#define COUT Rcpp::Rcout
+#define CERR Rcpp::Rcerr
+
+#include "evd_downdate.h"
+#include "evd.h"
+
+// Symmetric QR with eigenvectors takes about 9 n^3 flops (Golub and Van
+// Loan); a downdate's eigenvector product takes 2 n^3
+static const double kDecomposeFlops = 9.0;
+static const double kDowndateFlops = 2.0;
+
+namespace {
+    // One diagonal block being downdated: values ascending, vectors
+    // size() x values.size(), column-major
+    struct WorkBlock {
+        std::vector<int> rows;
+        std::vector<double> values;
+        Eigen::MatrixXd vectors;
+    };
+
+    // Root of sum_j z_j^2 / (delta_j - tau) = 0 in (lower, upper), where
+    // delta_j = d_j - origin; solved in the shifted variable so that
+    // d_j - mu = delta_j - tau keeps full precision near the origin pole
+    double solve_shifted(const std::vector<double>& delta, const std::vector<double>& z2,
+                         double lower, double upper) {
+        const double eps = std::numeric_limits<double>::epsilon();
+        double tau = 0.5 * (lower + upper);
+        for (int iteration = 0; iteration < 200; iteration++) {
+            double g = 0.0, slope = 0.0, scale = 0.0;
+            for (size_t j = 0; j < delta.size(); j++) {
+                double inverse = 1.0 / (delta[j] - tau);
+                double term = z2[j] * inverse;
+                g += term;
+                slope += term * inverse;
+                scale += std::fabs(term);
+            }
+            if (std::fabs(g) <= 4.0 * eps * delta.size() * scale) {
+                break;
+            }
+            // g increases between its poles
+            if (g > 0.0) {
+                upper = tau;
+            } else {
+                lower = tau;
+            }
+            if (upper - lower <= 2.0 * eps * std::max(std::fabs(lower), std::fabs(upper))) {
+                break;
+            }
+            double next = tau - g / slope;
+            tau = (next > lower && next < upper) ? next : 0.5 * (lower + upper);
+        }
+        return tau;
+    }
+
+    // Remove local row r from block (which must have at least two rows)
+    void remove_block_row(WorkBlock& block, size_t r) {
+        const double eps = std::numeric_limits<double>::epsilon();
+        size_t n = block.rows.size();
+        size_t m = block.values.size();
+        Eigen::MatrixXd& U = block.vectors;
+        std::vector<double>& d = block.values;
+
+        std::vector<double> z(m);
+        double max_value = 0.0;
+        for (size_t j = 0; j < m; j++) {
+            z[j] = U(r, j);
+            max_value = std::max(max_value, std::fabs(d[j]));
+        }
+
+        // Deflate: a component with z_j ~ 0 keeps its eigenpair, and a
+        // repeated eigenvalue is rotated so only one of its vectors
+        // touches row r (the columns of U are unit vectors, so |z| = 1)
+        const double z_tol = 8.0 * eps;
+        const double d_tol = 8.0 * eps * std::max(max_value, 1.0);
+        std::vector<size_t> kept;      // Deflated components
+        std::vector<size_t> secular;   // Components left in the secular equation
+        for (size_t j = 0; j < m; j++) {
+            if (std::fabs(z[j]) <= z_tol) {
+                kept.push_back(j);
+                continue;
+            }
+            if (!secular.empty()) {
+                size_t p = secular.back();
+                if (d[j] - d[p] <= d_tol) {
+                    double radius = std::hypot(z[p], z[j]);
+                    double c = z[j] / radius;
+                    double s = z[p] / radius;
+                    Eigen::VectorXd up = U.col(p);
+                    U.col(p) = c * up - s * U.col(j);
+                    U.col(j) = s * up + c * U.col(j);
+                    z[p] = 0.0;
+                    z[j] = radius;
+                    secular.pop_back();
+                    kept.push_back(p);
+                }
+            }
+            secular.push_back(j);
+        }
+
+        size_t k = secular.size();
+        std::vector<double> ds(k), z2(k);
+        double z_norm2 = 0.0;
+        for (size_t i = 0; i < k; i++) {
+            ds[i] = d[secular[i]];
+            z2[i] = z[secular[i]] * z[secular[i]];
+            z_norm2 += z2[i];
+        }
+
+        // One root in each gap, measured from the nearer pole
+        size_t n_roots = k > 0 ? k - 1 : 0;
+        std::vector<size_t> origin(n_roots);
+        std::vector<double> tau(n_roots);
+        std::vector<double> delta(k);
+        for (size_t l = 0; l < n_roots; l++) {
+            double gap = ds[l + 1] - ds[l];
+            double middle = 0.0;
+            for (size_t i = 0; i < k; i++) {
+                middle += z2[i] / (ds[i] - (ds[l] + 0.5 * gap));
+            }
+            origin[l] = middle > 0.0 ? l : l + 1;
+            for (size_t i = 0; i < k; i++) {
+                delta[i] = ds[i] - ds[origin[l]];
+            }
+            tau[l] = origin[l] == l ? solve_shifted(delta, z2, 0.0, 0.5 * gap)
+                                    : solve_shifted(delta, z2, -0.5 * gap, 0.0);
+        }
+        auto difference = [&](size_t i, size_t l) {  // d_i - mu_l
+            return (ds[i] - ds[origin[l]]) - tau[l];
+        };
+
+        // Gu-Eisenstat: the z for which the computed roots are exact
+        std::vector<double> z_hat(k);
+        for (size_t i = 0; i < k; i++) {
+            double product = z_norm2;
+            for (size_t j = 0; j < k; j++) {
+                if (j < i) {
+                    product *= difference(i, j) / (ds[i] - ds[j]);
+                } else if (j > i) {
+                    product *= difference(i, j - 1) / (ds[i] - ds[j]);
+                }
+            }
+            z_hat[i] = std::copysign(std::sqrt(std::fabs(product)), z[secular[i]]);
+        }
+
+        // Eigenvectors U_s (D - mu_l)^{-1} z_hat, normalised; dropping row
+        // r leaves their norm unchanged since the secular sum is zero there
+        Eigen::MatrixXd Y(k, n_roots);
+        for (size_t l = 0; l < n_roots; l++) {
+            for (size_t i = 0; i < k; i++) {
+                Y(i, l) = z_hat[i] / difference(i, l);
+            }
+            Y.col(l).normalize();
+        }
+        Eigen::MatrixXd Us(n, k);
+        for (size_t i = 0; i < k; i++) {
+            Us.col(i) = U.col(secular[i]);
+        }
+        Eigen::MatrixXd V;
+        V.noalias() = Us * Y;
+
+        // Merge kept and new eigenpairs in ascending order, without row r
+        std::vector<std::pair<double, const double*>> pairs;
+        pairs.reserve(n - 1);
+        for (size_t j : kept) {
+            pairs.emplace_back(d[j], U.col(j).data());
+        }
+        for (size_t l = 0; l < n_roots; l++) {
+            pairs.emplace_back(ds[origin[l]] + tau[l], V.col(l).data());
+        }
+        std::stable_sort(pairs.begin(), pairs.end(),
+                         [](const std::pair<double, const double*>& a, const std::pair<double, const double*>& b) {
+                             return a.first < b.first;
+                         });
+
+        Eigen::MatrixXd vectors(n - 1, pairs.size());
+        std::vector<double> values(pairs.size());
+        for (size_t c = 0; c < pairs.size(); c++) {
+            values[c] = pairs[c].first;
+            const double* column = pairs[c].second;
+            for (size_t i = 0, out = 0; i < n; i++) {
+                if (i != r) {
+                    vectors(out++, c) = column[i];
+                }
+            }
+        }
+
+        block.rows.erase(block.rows.begin() + r);
+        block.values.swap(values);
+        block.vectors.swap(vectors);
+    }
+}
+
+bool EvdDowndate::rows_to_remove(const std::vector<std::string>& base_ids, const std::vector<std::string>& ids,
+                                 std::vector<size_t>& removed) {
+    removed.clear();
+    size_t next = 0;
+    for (size_t row = 0; row < base_ids.size(); row++) {
+        if (next < ids.size() && base_ids[row] == ids[next]) {
+            next++;
+        } else {
+            removed.push_back(row);
+        }
+    }
+    return next == ids.size();
+}
+
+double EvdDowndate::cost_ratio(const Evd& base, const std::vector<size_t>& removed) {
+    std::vector<int> block_of(base.num_subjects(), -1);
+    for (size_t b = 0; b < base.blocks.size(); b++) {
+        for (int row : base.blocks[b].rows) {
+            block_of[row] = static_cast<int>(b);
+        }
+    }
+
+    std::vector<double> sizes(base.blocks.size());
+    for (size_t b = 0; b < base.blocks.size(); b++) {
+        sizes[b] = static_cast<double>(base.blocks[b].size());
+    }
+
+    double downdate = 0.0;
+    for (size_t row : removed) {
+        double n = sizes[block_of[row]];
+        downdate += kDowndateFlops * n * n * n;
+        sizes[block_of[row]] -= 1.0;
+    }
+
+    double decompose = 0.0;
+    for (double n : sizes) {
+        decompose += kDecomposeFlops * n * n * n;
+    }
+    return decompose > 0.0 ? downdate / decompose : std::numeric_limits<double>::infinity();
+}
+
+double EvdDowndate::cost_ratio(size_t n_subjects, size_t n_removed) {
+    if (n_removed >= n_subjects) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double downdate = 0.0;
+    for (size_t k = 0; k < n_removed; k++) {
+        double n = static_cast<double>(n_subjects - k);
+        downdate += kDowndateFlops * n * n * n;
+    }
+    double n = static_cast<double>(n_subjects - n_removed);
+    return downdate / (kDecomposeFlops * n * n * n);
+}
+
+int EvdDowndate::remove_rows(const Evd& base, const std::vector<size_t>& removed, Evd& result) {
+    size_t n_subjects = base.num_subjects();
+    std::vector<char> is_removed(n_subjects, 0);
+    for (size_t row : removed) {
+        if (row >= n_subjects) {
+            CERR << "Error: EVD downdate row " << row << " out of range" << std::endl;
+            return 1;
+        }
+        is_removed[row] = 1;
+    }
+
+    // Old row -> new row
+    std::vector<int> new_row(n_subjects, -1);
+    result = Evd();
+    for (size_t row = 0; row < n_subjects; row++) {
+        if (!is_removed[row]) {
+            new_row[row] = static_cast<int>(result.ids.size());
+            result.ids.push_back(base.ids[row]);
+        }
+    }
+
+    for (const auto& block : base.blocks) {
+        size_t n = block.size();
+        std::vector<size_t> local;
+        for (size_t i = 0; i < n; i++) {
+            if (is_removed[block.rows[i]]) {
+                local.push_back(i);
+            }
+        }
+
+        EvdBlock out;
+        if (local.empty()) {
+            out.rows = block.rows;
+            out.values = block.values;
+            out.vectors.assign(block.vector_data(), block.vector_data() + n * block.num_components());
+        } else if (local.size() < n) {
+            if (block.num_components() != n) {
+                CERR << "Error: EVD downdate needs every eigenvector of a block" << std::endl;
+                return 1;
+            }
+            WorkBlock work;
+            work.rows = block.rows;
+            work.values = block.values;
+            work.vectors = Eigen::Map<const Eigen::MatrixXd>(block.vector_data(), n, n);
+
+            // From the last row down, so earlier local indices stay valid
+            for (auto it = local.rbegin(); it != local.rend(); ++it) {
+                remove_block_row(work, *it);
+            }
+            out.rows = std::move(work.rows);
+            out.values = std::move(work.values);
+            out.vectors.assign(work.vectors.data(), work.vectors.data() + work.vectors.size());
+        } else {
+            continue;  // Every subject of the block removed
+        }
+
+        for (int& row : out.rows) {
+            row = new_row[row];
+        }
+        result.blocks.push_back(std::move(out));
+    }
+    return 0;
+}
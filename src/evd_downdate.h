@@ -0,0 +1,46 @@
+/*
+ * evd_downdate.h - Remove subjects from an existing phi2 decomposition
+ *
+ * Deleting row and column r of K = U diag(d) U^T leaves a matrix whose
+ * eigenvalues are the roots of the secular equation
+ *   sum_j z_j^2 / (d_j - mu) = 0,   z = U^T e_r,
+ * one in each gap of d, and whose eigenvectors are U (D - mu)^{-1} z
+ * with row r dropped. Components with z_j ~ 0 or a repeated d_j are
+ * deflated first; z is then recomputed from the roots (Gu and Eisenstat)
+ * so the new eigenvectors stay orthogonal. Each subject removed costs one
+ * n_b^2 root solve and one n_b x n_b matrix product for its family block
+ * (the whole matrix for a dense EVD), against O(n^3) for a new
+ * decomposition, so it pays off when a subject set differs from a cached
+ * one by a few subjects.
+ */
+
+#ifndef EVD_DOWNDATE_H
+#define EVD_DOWNDATE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Evd;
+
+class EvdDowndate {
+public:
+    // Rows of base_ids to remove to leave exactly ids (both in pedigree
+    // order); false if ids is not a subset of base_ids
+    static bool rows_to_remove(const std::vector<std::string>& base_ids, const std::vector<std::string>& ids,
+                               std::vector<size_t>& removed);
+
+    // Estimated cost of removing rows from base relative to decomposing
+    // the remaining subjects from scratch (flop estimates; below 1 the
+    // downdate is expected to be faster)
+    static double cost_ratio(const Evd& base, const std::vector<size_t>& removed);
+
+    // The same estimate for a dense EVD of n_subjects, before it exists
+    static double cost_ratio(size_t n_subjects, size_t n_removed);
+
+    // Decomposition of base without the given rows (sorted ascending).
+    // Returns 0 on success, 1 on failure
+    static int remove_rows(const Evd& base, const std::vector<size_t>& removed, Evd& result);
+};
+
+#endif // EVD_DOWNDATE_H
@@ -0,0 +1,301 @@
+/*
+ * evd_file.cc - Binary EVD file reader and writer
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstring>
+#include <zlib.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include <Rcpp.h>
+#define COUT Rcpp::Rcout
+#define CERR Rcpp::Rcerr
+
+#include "evd_file.h"
+#include "evd.h"
+#include "mapped_file.h"
+
+static_assert(sizeof(int) == sizeof(int32_t), "EVD block rows are stored as int32");
+
+static const char kEvdMagic[8] = {'S', 'O', 'L', 'A', 'R', 'E', 'V', 'D'};
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+// zlib's crc32 takes 32-bit lengths, so feed large buffers in pieces
+static uLong update_crc(uLong crc, const char* data, size_t size) {
+    const size_t max_chunk = 1u << 30;
+    while (size > 0) {
+        size_t chunk = size < max_chunk ? size : max_chunk;
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(chunk));
+        data += chunk;
+        size -= chunk;
+    }
+    return crc;
+}
+
+// Temporary name beside path, unique to this process and call, so that
+// two writers of the same file never write into one temporary
+static std::string temp_path_for(const std::string& path) {
+    static std::atomic<unsigned> counter(0);
+    return path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++);
+}
+
+// Output stream wrapper that tracks the byte offset and running CRC
+class ChecksumWriter {
+public:
+    explicit ChecksumWriter(std::ofstream& out) : out_(out), crc_(crc32(0L, Z_NULL, 0)) {}
+
+    void write(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        out_.write(bytes, size);
+        crc_ = update_crc(crc_, bytes, size);
+        offset_ += size;
+    }
+
+    void pad_to(uint64_t offset) {
+        static const char zeros[8] = {0};
+        if (offset > offset_) {
+            write(zeros, offset - offset_);
+        }
+    }
+
+    uint64_t offset() const { return offset_; }
+    uLong crc() const { return crc_; }
+
+private:
+    std::ofstream& out_;
+    uLong crc_;
+    uint64_t offset_ = 0;
+};
+
+int EvdFile::write(const Evd& evd, const std::string& path) {
+    EvdFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kEvdMagic, sizeof(kEvdMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrderMark;
+    header.n_subjects = evd.ids.size();
+    header.n_blocks = evd.blocks.size();
+    header.n_components = evd.num_components();
+    header.remainder_value = evd.remainder_value;
+
+    // Lay out sections
+    uint64_t offset = sizeof(EvdFileHeader);
+    header.ids_offset = offset;
+    for (const auto& id : evd.ids) {
+        offset += sizeof(uint32_t) + id.size();
+    }
+    header.blocks_offset = align8(offset);
+    header.rows_offset = header.blocks_offset + header.n_blocks * 3 * sizeof(uint64_t);
+
+    uint64_t n_rows = 0;
+    uint64_t n_vector_elements = 0;
+    for (const auto& block : evd.blocks) {
+        n_rows += block.size();
+        n_vector_elements += static_cast<uint64_t>(block.size()) * block.num_components();
+    }
+    header.values_offset = align8(header.rows_offset + n_rows * sizeof(int32_t));
+    header.vectors_offset = header.values_offset + header.n_components * sizeof(double);
+    header.checksum_offset = header.vectors_offset + n_vector_elements * sizeof(double);
+
+    // Write beside the final path and rename: truncating in place would
+    // pull the pages from under any live mapping of the old file
+    std::string temp_path = temp_path_for(path);
+    std::ofstream out(temp_path, std::ios::binary);
+    if (!out) {
+        CERR << "Error: Cannot create EVD file " << path << std::endl;
+        return 1;
+    }
+
+    ChecksumWriter writer(out);
+    writer.write(&header, sizeof(header));
+
+    for (const auto& id : evd.ids) {
+        uint32_t length = static_cast<uint32_t>(id.size());
+        writer.write(&length, sizeof(length));
+        writer.write(id.data(), id.size());
+    }
+
+    writer.pad_to(header.blocks_offset);
+    uint64_t first_element = 0;
+    for (const auto& block : evd.blocks) {
+        uint64_t entry[3] = {block.size(), block.num_components(), first_element};
+        writer.write(entry, sizeof(entry));
+        first_element += static_cast<uint64_t>(block.size()) * block.num_components();
+    }
+
+    for (const auto& block : evd.blocks) {
+        writer.write(block.rows.data(), block.rows.size() * sizeof(int32_t));
+    }
+
+    writer.pad_to(header.values_offset);
+    for (const auto& block : evd.blocks) {
+        writer.write(block.values.data(), block.values.size() * sizeof(double));
+    }
+
+    for (const auto& block : evd.blocks) {
+        writer.write(block.vector_data(), block.size() * block.num_components() * sizeof(double));
+    }
+
+    uint64_t checksum = writer.crc();
+    out.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    out.close();
+
+    if (!out) {
+        CERR << "Error: Failed writing EVD file " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return 1;
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        CERR << "Error: Cannot create EVD file " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int EvdFile::read(const std::string& path, Evd& evd, bool verify_checksum) {
+    auto file = MappedFile::open(path);
+    if (!file) {
+        CERR << "Error: Cannot read EVD file: " << path << std::endl;
+        CERR << "Make sure create_evd_data has been run first" << std::endl;
+        return 1;
+    }
+
+    const char* data = file->data();
+    uint64_t size = file->size();
+
+    // A version 1 header is the version 2 header without remainder_value
+    const size_t v1_header_size = offsetof(EvdFileHeader, remainder_value);
+    EvdFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    if (size < v1_header_size + sizeof(uint64_t)) {
+        CERR << "Error: EVD file is truncated: " << path << std::endl;
+        return 1;
+    }
+    std::memcpy(&header, data, v1_header_size);
+
+    if (std::memcmp(header.magic, kEvdMagic, sizeof(kEvdMagic)) != 0) {
+        CERR << "Error: Not an EVD file: " << path << std::endl;
+        return 1;
+    }
+    if (header.byte_order != kByteOrderMark) {
+        CERR << "Error: EVD file was written with a different byte order: " << path << std::endl;
+        return 1;
+    }
+    if (header.version != 1 && header.version != kVersion) {
+        CERR << "Error: Unsupported EVD file version " << header.version << ": " << path << std::endl;
+        return 1;
+    }
+    if (header.version >= 2) {
+        if (size < sizeof(header) + sizeof(uint64_t)) {
+            CERR << "Error: EVD file is truncated: " << path << std::endl;
+            return 1;
+        }
+        std::memcpy(&header, data, sizeof(header));
+    }
+    if (header.checksum_offset + sizeof(uint64_t) != size ||
+        header.ids_offset > header.blocks_offset ||
+        header.blocks_offset + header.n_blocks * 3 * sizeof(uint64_t) > header.rows_offset ||
+        header.rows_offset > header.values_offset ||
+        header.values_offset + header.n_components * sizeof(double) > header.vectors_offset ||
+        header.vectors_offset > header.checksum_offset) {
+        CERR << "Error: EVD file has an invalid layout: " << path << std::endl;
+        return 1;
+    }
+
+    if (verify_checksum) {
+        uint64_t stored;
+        std::memcpy(&stored, data + header.checksum_offset, sizeof(stored));
+        uLong crc = update_crc(crc32(0L, Z_NULL, 0), data, header.checksum_offset);
+        if (stored != static_cast<uint64_t>(crc)) {
+            CERR << "Error: EVD file checksum mismatch (file is corrupt): " << path << std::endl;
+            return 1;
+        }
+    }
+
+    // IDs
+    evd.ids.clear();
+    evd.ids.reserve(header.n_subjects);
+    uint64_t offset = header.ids_offset;
+    for (uint64_t i = 0; i < header.n_subjects; i++) {
+        uint32_t length;
+        if (offset + sizeof(length) > header.blocks_offset) {
+            CERR << "Error: EVD file has truncated IDs: " << path << std::endl;
+            return 1;
+        }
+        std::memcpy(&length, data + offset, sizeof(length));
+        offset += sizeof(length);
+        if (offset + length > header.blocks_offset) {
+            CERR << "Error: EVD file has truncated IDs: " << path << std::endl;
+            return 1;
+        }
+        evd.ids.emplace_back(data + offset, length);
+        offset += length;
+    }
+
+    // Blocks, whose rows must cover every subject exactly once
+    std::vector<char> covered(header.n_subjects, 0);
+    evd.blocks.clear();
+    evd.blocks.resize(header.n_blocks);
+    uint64_t row_offset = header.rows_offset;
+    uint64_t value_offset = header.values_offset;
+    for (uint64_t b = 0; b < header.n_blocks; b++) {
+        uint64_t entry[3];
+        std::memcpy(entry, data + header.blocks_offset + b * sizeof(entry), sizeof(entry));
+        uint64_t n_rows = entry[0];
+        uint64_t n_components = entry[1];
+        uint64_t vector_offset = header.vectors_offset + entry[2] * sizeof(double);
+
+        if (row_offset + n_rows * sizeof(int32_t) > header.values_offset ||
+            value_offset + n_components * sizeof(double) > header.vectors_offset ||
+            vector_offset + n_rows * n_components * sizeof(double) > header.checksum_offset) {
+            CERR << "Error: EVD file has an invalid block table: " << path << std::endl;
+            return 1;
+        }
+
+        EvdBlock& block = evd.blocks[b];
+        block.rows.resize(n_rows);
+        std::memcpy(block.rows.data(), data + row_offset, n_rows * sizeof(int32_t));
+        row_offset += n_rows * sizeof(int32_t);
+        for (int row : block.rows) {
+            if (row < 0 || static_cast<uint64_t>(row) >= header.n_subjects || covered[row]) {
+                CERR << "Error: EVD file has an invalid block row: " << path << std::endl;
+                return 1;
+            }
+            covered[row] = 1;
+        }
+
+        block.values.resize(n_components);
+        std::memcpy(block.values.data(), data + value_offset, n_components * sizeof(double));
+        value_offset += n_components * sizeof(double);
+
+        // Eigenvectors stay in the mapping
+        block.vectors.clear();
+        block.mapped_vectors = reinterpret_cast<const double*>(data + vector_offset);
+    }
+
+    if (std::find(covered.begin(), covered.end(), 0) != covered.end()) {
+        CERR << "Error: EVD file blocks do not cover every subject: " << path << std::endl;
+        return 1;
+    }
+
+    evd.remainder_value = header.remainder_value;
+    evd.mapping = file;
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * evd_file.h - Versioned binary EVD file (<basename>.evd)
+ *
+ * Layout (native byte order, all sections 8-byte aligned):
+ *   header        EvdFileHeader
+ *   ids           per subject: uint32 length + bytes
+ *   block table   per block: uint64 rows, uint64 components, uint64 first vector element
+ *   block rows    int32 subject rows, blocks concatenated
+ *   eigenvalues   float64, blocks concatenated
+ *   eigenvectors  float64, column-major per block, blocks concatenated
+ *   checksum      uint64 CRC-32 of every preceding byte
+ *
+ * Version 2 adds remainder_value to the header, for low-rank EVDs with
+ * fewer components than subjects; version 1 files read with it 0.
+ *
+ * Readers map the file and point eigenvector blocks straight into the
+ * mapping, so nothing O(n^2) is parsed or copied.
+ */
+
+#ifndef EVD_FILE_H
+#define EVD_FILE_H
+
+#include <cstdint>
+#include <string>
+
+class Evd;
+
+struct EvdFileHeader {
+    char magic[8];            // "SOLAREVD"
+    uint32_t version;
+    uint32_t byte_order;      // kByteOrderMark as written by the producer
+    uint64_t n_subjects;
+    uint64_t n_blocks;
+    uint64_t n_components;
+    uint64_t ids_offset;
+    uint64_t blocks_offset;
+    uint64_t rows_offset;
+    uint64_t values_offset;
+    uint64_t vectors_offset;
+    uint64_t checksum_offset;
+    double remainder_value;   // Version 2: eigenvalue of the components not stored
+};
+
+class EvdFile {
+public:
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint32_t kByteOrderMark = 0x01020304;
+
+    // Write evd to path (through path.tmp and a rename, so existing
+    // mappings of path stay valid); returns 0 on success, 1 on failure
+    static int write(const Evd& evd, const std::string& path);
+
+    // Map path into evd (eigenvectors are not copied); verify_checksum
+    // reads the whole file once to check the trailing CRC. Block rows
+    // must cover every subject exactly once.
+    // Returns 0 on success, 1 on failure
+    static int read(const std::string& path, Evd& evd, bool verify_checksum = true);
+};
+
+#endif // EVD_FILE_H
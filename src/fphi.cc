@@ -1,44 +1,35 @@
 #include <fstream>
 #include <vector>
 #include <string>
-#include <sstream>
 #include <iomanip>
 #include <cmath>
 #include <algorithm>
+#include <mutex>
 
 #include <Rcpp.h>
 #define COUT Rcpp::Rcout
 #define CERR Rcpp::Rcerr
 
+#include "Eigen/Dense"
+#include "evd.h"
+#include "evd_file.h"
 #include "fphi.h"
+#include "parallel_for.h"
 #include "pedigree.h"
 #include "phenotypes.h"
 
 // FORTRAN cdfchi routine (exact match to original SOLAR)
 extern "C" void cdfchi_(int* which, double* p, double* q, double* chi, double* df, int* status, double* bound);
 
-// Helper function to extract directory from a path
-static std::string extract_directory(const char* path) {
-    if (!path || strlen(path) == 0) {
-        return "";
-    }
-
-    std::string fullpath(path);
-    size_t last_slash = fullpath.find_last_of("/\\");
-
-    if (last_slash == std::string::npos) {
-        return ""; // No directory component
-    }
-
-    return fullpath.substr(0, last_slash);
-}
-
 // High-precision chi-square p-value calculation (matching original SOLAR)
+// DCDFLIB keeps SAVEd Fortran state, so calls are serialized for batch fits
 static double chicdf(double chi, double df) {
+    static std::mutex cdfchi_mutex;
     double p, q, bound;
     int status = 0;
     int which = 1;
-    
+
+    std::lock_guard<std::mutex> lock(cdfchi_mutex);
     cdfchi_(&which, &p, &q, &chi, &df, &status, &bound);
     return q/2.0;  // Matches original SOLAR implementation
 }
@@ -57,12 +48,31 @@ static inline double calculate_ddconstraint(double x) {
     return -2 * (3 * x * x - 1) / std::pow((x * x + 1), 3);
 }
 
-// Log-likelihood calculation (exact match to original SOLAR)
-static inline double calculate_fphi_loglik(double variance, const std::vector<double>& sigma, size_t n_subjects) {
+// Components that share one eigenvalue and enter the fit only through
+// their sums (the null space of a low-rank EVD); with count 0 the fit is
+// exactly the per-component one
+struct EigenvalueGroup {
+    double value = 0.0;  // Shared eigenvalue
+    double count = 0.0;  // Number of components
+    double yy = 0.0;     // Sum of Y^2 over the group's components
+    double xy = 0.0;     // Sum of X*Y
+    double xx = 0.0;     // Sum of X^2
+
+    // Sum of (Y - X*beta)^2 over the group
+    double residual_squared(double beta) const {
+        return std::max(yy - 2.0 * beta * xy + beta * beta * xx, 0.0);
+    }
+};
+
+// Log-likelihood calculation (exact match to original SOLAR); group_log_sigma
+// adds the log Sigma terms of an eigenvalue group, n_subjects includes it
+static inline double calculate_fphi_loglik(double variance, const std::vector<double>& sigma, double n_subjects,
+                                           double group_log_sigma = 0.0) {
     double log_sigma_sum = 0.0;
     for (double s : sigma) {
         log_sigma_sum += std::log(std::abs(s));
     }
+    log_sigma_sum += group_log_sigma;
     return -0.5 * (std::log(std::abs(variance)) * n_subjects + log_sigma_sum + n_subjects);
 }
 
@@ -90,6 +100,27 @@ static inline double calculate_ddloglik(const std::vector<double>& lambda_minus_
     return -0.5 * (-part_one + part_two);
 }
 
+// The group's terms of calculate_dloglik and calculate_ddloglik, from its
+// Sigma and residual sum of squares
+static inline double group_dloglik(const EigenvalueGroup& group, double sigma, double residual_squared,
+                                   double variance) {
+    double lambda_minus_one = group.value - 1.0;
+    double sigma_inv_var = 1.0 / (sigma * variance);
+    double part_one = group.count * variance * lambda_minus_one * sigma_inv_var;
+    double part_two = variance * lambda_minus_one * residual_squared * sigma_inv_var * sigma_inv_var;
+    return -0.5 * (part_one - part_two);
+}
+
+static inline double group_ddloglik(const EigenvalueGroup& group, double sigma, double residual_squared,
+                                    double variance) {
+    double lm1_sq = (group.value - 1.0) * (group.value - 1.0);
+    double sigma_inv_var = 1.0 / (sigma * variance);
+    double sig_sq = sigma_inv_var * sigma_inv_var;
+    double part_one = group.count * variance * variance * lm1_sq * sig_sq;
+    double part_two = 2.0 * variance * variance * lm1_sq * residual_squared * sigma_inv_var * sig_sq;
+    return -0.5 * (-part_one + part_two);
+}
+
 // Matrix inversion for Hessian computation
 static bool matrix_invert(std::vector<std::vector<double>>& matrix) {
     size_t n = matrix.size();
@@ -158,15 +189,19 @@ static inline double calculate_dloglik_with_constraint(const double t, const dou
     return calculate_dconstraint(t)*dloglik;
 }
 
-// Exact SOLAR find_max_loglik_2 implementation
+// Exact SOLAR find_max_loglik_2 implementation, plus an optional group of
+// components sharing one eigenvalue whose terms are added to every sum
 static double find_max_loglik_2(const int precision, const std::vector<double>& Y,
                                const std::vector<std::vector<double>>& aux,
                                const std::vector<double>& X,
+                               const EigenvalueGroup& group,
                                double& result_loglik, double& result_variance, double& result_se,
                                double& result_mean, double& result_mean_se,
                                double& result_e2, double& result_e2_se,
                                double& result_sd, double& result_sd_se) {
     size_t n_subjects = Y.size();
+    const bool grouped = group.count > 0.0;
+    const double n_total = n_subjects + group.count;
     
     // Initialize like SOLAR lines 143-147
     double parameter_t = 1.0;
@@ -187,11 +222,17 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
         Omega_diag[i] = 1.0 / Sigma[i];
     }
     
+    // The group's Sigma (its aux row is [1, value])
+    double group_sigma = theta[0] + group.value * theta[1];
+
     // XTOX = X^T * Omega * X (lines 150-151)
     double XTOX = 0.0;
     for (size_t i = 0; i < n_subjects; i++) {
         XTOX += X[i] * Omega_diag[i] * X[i];
     }
+    if (grouped) {
+        XTOX += group.xx / group_sigma;
+    }
     
     if (XTOX == 0.0) {
         return 0.0; // Convergence failure
@@ -202,6 +243,9 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
     for (size_t i = 0; i < n_subjects; i++) {
         XTOmegaY += X[i] * Omega_diag[i] * Y[i];
     }
+    if (grouped) {
+        XTOmegaY += group.xy / group_sigma;
+    }
     double beta = XTOmegaY / XTOX;
     
     // residual = Y - X*beta (line 157)
@@ -212,14 +256,22 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
         residual_squared[i] = residual[i] * residual[i];
     }
     
+    double group_residual_squared = grouped ? group.residual_squared(beta) : 0.0;
+
     // variance = residual^T * Omega * residual / n (line 159)
     double variance = 0.0;
     for (size_t i = 0; i < n_subjects; i++) {
         variance += residual_squared[i] * Omega_diag[i];
     }
-    variance /= n_subjects;
+    if (grouped) {
+        variance += group_residual_squared / group_sigma;
+    }
+    variance /= n_total;
     
-    double loglik = calculate_fphi_loglik(variance, Sigma, n_subjects);
+    auto group_log_sigma = [&](double sigma) {
+        return grouped ? group.count * std::log(std::abs(sigma)) : 0.0;
+    };
+    double loglik = calculate_fphi_loglik(variance, Sigma, n_total, group_log_sigma(group_sigma));
     
     // lambda_minus_one = aux.col(1) - 1 (line 161)
     std::vector<double> lambda_minus_one(n_subjects);
@@ -236,6 +288,10 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
     // Calculate derivatives (lines 163-164)
     double dloglik = calculate_dloglik(lambda_minus_one, residual_squared, sigma_inverse_var, variance);
     double ddloglik = calculate_ddloglik(lambda_minus_one, residual_squared, sigma_inverse_var, variance);
+    if (grouped) {
+        dloglik += group_dloglik(group, group_sigma, group_residual_squared, variance);
+        ddloglik += group_ddloglik(group, group_sigma, group_residual_squared, variance);
+    }
     double score = calculate_dloglik_with_constraint(parameter_t, dloglik);
     double hessian = calculate_ddloglik_with_constraint(parameter_t, dloglik, ddloglik);
     double delta = -score / hessian;
@@ -262,6 +318,8 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
             sigma_inverse_var[i] = 1.0 / Sigma[i];
         }
         
+        group_sigma = theta[0] + group.value * theta[1];
+        
         // Update Omega
         for (size_t i = 0; i < n_subjects; i++) {
             Omega_diag[i] = sigma_inverse_var[i];
@@ -272,6 +330,9 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
         for (size_t i = 0; i < n_subjects; i++) {
             XTOX += X[i] * Omega_diag[i] * X[i];
         }
+        if (grouped) {
+            XTOX += group.xx / group_sigma;
+        }
         
         if (XTOX == 0.0) {
             return 0.0; // Convergence failure
@@ -282,6 +343,9 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
         for (size_t i = 0; i < n_subjects; i++) {
             XTOmegaY += X[i] * Omega_diag[i] * Y[i];
         }
+        if (grouped) {
+            XTOmegaY += group.xy / group_sigma;
+        }
         beta = XTOmegaY / XTOX;
         
         // Update residual and variance
@@ -290,20 +354,29 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
             residual_squared[i] = residual[i] * residual[i];
         }
         
+        group_residual_squared = grouped ? group.residual_squared(beta) : 0.0;
+        
         variance = 0.0;
         for (size_t i = 0; i < n_subjects; i++) {
             variance += residual_squared[i] * sigma_inverse_var[i];
         }
-        variance /= n_subjects;
+        if (grouped) {
+            variance += group_residual_squared / group_sigma;
+        }
+        variance /= n_total;
         
         // Update sigma_inverse_var with new variance
         for (size_t i = 0; i < n_subjects; i++) {
             sigma_inverse_var[i] /= variance;
         }
         
-        loglik = calculate_fphi_loglik(variance, Sigma, n_subjects);
+        loglik = calculate_fphi_loglik(variance, Sigma, n_total, group_log_sigma(group_sigma));
         dloglik = calculate_dloglik(lambda_minus_one, residual_squared, sigma_inverse_var, variance);
         ddloglik = calculate_ddloglik(lambda_minus_one, residual_squared, sigma_inverse_var, variance);
+        if (grouped) {
+            dloglik += group_dloglik(group, group_sigma, group_residual_squared, variance);
+            ddloglik += group_ddloglik(group, group_sigma, group_residual_squared, variance);
+        }
         score = calculate_dloglik_with_constraint(parameter_t, dloglik);
         hessian = calculate_ddloglik_with_constraint(parameter_t, dloglik, ddloglik);
         delta = -score / hessian;
@@ -329,16 +402,24 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
             test_sigma_inverse[i] = 1.0 / test_sigma[i];
         }
         
+        double test_group_sigma = test_theta[0] + group.value * test_theta[1];
+        
         double test_XTOX = 0.0;
         for (size_t i = 0; i < n_subjects; i++) {
             test_XTOX += X[i] * test_sigma_inverse[i] * X[i];
         }
+        if (grouped) {
+            test_XTOX += group.xx / test_group_sigma;
+        }
         
         if (test_XTOX != 0.0) {
             double test_XTOmegaY = 0.0;
             for (size_t i = 0; i < n_subjects; i++) {
                 test_XTOmegaY += X[i] * test_sigma_inverse[i] * Y[i];
             }
+            if (grouped) {
+                test_XTOmegaY += group.xy / test_group_sigma;
+            }
             double test_beta = test_XTOmegaY / test_XTOX;
             
             double test_variance = 0.0;
@@ -346,9 +427,13 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
                 double test_residual = Y[i] - X[i] * test_beta;
                 test_variance += test_residual * test_residual * test_sigma_inverse[i];
             }
-            test_variance /= n_subjects;
+            if (grouped) {
+                test_variance += group.residual_squared(test_beta) / test_group_sigma;
+            }
+            test_variance /= n_total;
             
-            double test_loglik = calculate_fphi_loglik(test_variance, test_sigma, n_subjects);
+            double test_loglik = calculate_fphi_loglik(test_variance, test_sigma, n_total,
+                                                       group_log_sigma(test_group_sigma));
             
             if (test_loglik > loglik) {
                 beta = test_beta;
@@ -376,12 +461,18 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
         final_omega_inv[i] = 1.0 / final_sigma[i];
     }
 
+    double final_group_omega = 1.0 / (variance * (final_theta[0] + group.value * final_theta[1]));
+
     double final_XTOX = 0.0;
     double final_XTOmegaY = 0.0;
     for (size_t i = 0; i < n_subjects; i++) {
         final_XTOX += X[i] * final_omega_inv[i] * X[i];
         final_XTOmegaY += X[i] * final_omega_inv[i] * Y[i];
     }
+    if (grouped) {
+        final_XTOX += group.xx * final_group_omega;
+        final_XTOmegaY += group.xy * final_group_omega;
+    }
     double final_beta = final_XTOmegaY / final_XTOX;
 
     // Parameter values - match original SOLAR exactly
@@ -404,6 +495,11 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
         final_omega_diagonal[i] = 1.0 / final_sigma[i];
     }
 
+    // Group sums of X * residual and residual^2 at the final beta
+    double group_x_residual = group.xy - final_beta * group.xx;
+    double group_final_residual_squared = grouped ? group.residual_squared(final_beta) : 0.0;
+    double group_one_minus_lambda = 1.0 - group.value;
+
     // Compute observed Hessian (exact SOLAR implementation)
     double SD = std::sqrt(variance);
 
@@ -412,18 +508,27 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
     for (size_t i = 0; i < n_subjects; i++) {
         beta_hessian += X[i] * final_omega_diagonal[i] * X[i];
     }
+    if (grouped) {
+        beta_hessian += group.xx * final_group_omega;
+    }
 
     // Beta-e2 cross terms
     double beta_var_comp_hessian = 0.0;
     for (size_t i = 0; i < n_subjects; i++) {
         beta_var_comp_hessian += SD * SD * X[i] * final_omega_diagonal[i] * final_omega_diagonal[i] * one_minus_lambda[i] * final_residual[i];
     }
+    if (grouped) {
+        beta_var_comp_hessian += SD * SD * final_group_omega * final_group_omega * group_one_minus_lambda * group_x_residual;
+    }
 
     // Beta-SD cross terms
     double beta_SD_hessian = 0.0;
     for (size_t i = 0; i < n_subjects; i++) {
         beta_SD_hessian += 2.0 * X[i] * final_residual[i] * final_omega_diagonal[i] / SD;
     }
+    if (grouped) {
+        beta_SD_hessian += 2.0 * group_x_residual * final_group_omega / SD;
+    }
 
     // e2-e2 block
     double one_minus_lambda_squared_sum = 0.0;
@@ -434,6 +539,12 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
         one_minus_lambda_squared_sum += oml_sq * omega_sq;
         residual_term_sum += oml_sq * final_omega_diagonal[i] * omega_sq * final_residual[i] * final_residual[i];
     }
+    if (grouped) {
+        double oml_sq = group_one_minus_lambda * group_one_minus_lambda;
+        double omega_sq = final_group_omega * final_group_omega;
+        one_minus_lambda_squared_sum += group.count * oml_sq * omega_sq;
+        residual_term_sum += oml_sq * final_group_omega * omega_sq * group_final_residual_squared;
+    }
     double e2_hessian = -std::pow(SD, 4.0) * (0.5 * one_minus_lambda_squared_sum - residual_term_sum);
 
     // SD-e2 cross terms
@@ -441,13 +552,19 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
     for (size_t i = 0; i < n_subjects; i++) {
         SD_e2_hessian += SD * one_minus_lambda[i] * std::pow(final_residual[i] * final_omega_diagonal[i], 2);
     }
+    if (grouped) {
+        SD_e2_hessian += SD * group_one_minus_lambda * group_final_residual_squared * final_group_omega * final_group_omega;
+    }
 
     // SD-SD block
     double residual_squared_omega_sum = 0.0;
     for (size_t i = 0; i < n_subjects; i++) {
         residual_squared_omega_sum += final_residual[i] * final_residual[i] * final_omega_diagonal[i];
     }
-    double SD_hessian = -std::pow(SD, -2.0) * (n_subjects - 3.0 * residual_squared_omega_sum);
+    if (grouped) {
+        residual_squared_omega_sum += group_final_residual_squared * final_group_omega;
+    }
+    double SD_hessian = -std::pow(SD, -2.0) * (n_total - 3.0 * residual_squared_omega_sum);
 
     // Build 3x3 Hessian matrix: [beta, e2, SD]
     std::vector<std::vector<double>> hessian_matrix(3, std::vector<double>(3, 0.0));
@@ -477,8 +594,145 @@ static double find_max_loglik_2(const int precision, const std::vector<double>&
     return h2r;
 }
 
+// Map the <basename>.evd file written by CreateEVD::create_evd_data
+static int read_evd_files(const char* evd_data_basename, Evd& evd) {
+    if (EvdFile::read(std::string(evd_data_basename) + ".evd", evd) != 0) {
+        return 1;
+    }
+
+    if (evd.ids.empty()) {
+        CERR << "Error: No IDs found in EVD data" << std::endl;
+        return 1;
+    }
+    if (evd.num_components() > evd.num_subjects()) {
+        CERR << "Error: Mismatch between number of IDs (" << evd.num_subjects()
+                  << ") and eigenvalues (" << evd.num_components() << ")" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Find the loaded phenotype column of every requested trait
+static int find_trait_columns(const Phenotypes* phenotypes,
+                              const std::vector<std::string>& trait_names,
+                              std::vector<const double*>& columns) {
+    if (!phenotypes->has_ids()) {
+        CERR << "Error: Cannot find required columns in phenotype data" << std::endl;
+        return 1;
+    }
+
+    columns.clear();
+    for (const auto& trait_name : trait_names) {
+        int index = phenotypes->find_trait(trait_name);
+        if (index == -1) {
+            CERR << "Error: Trait '" << trait_name << "' not found in phenotype data" << std::endl;
+            return 1;
+        }
+        columns.push_back(phenotypes->get_trait(index));
+    }
+    return 0;
+}
+
+// Group of the components a low-rank EVD does not store. They span the
+// orthogonal complement of its eigenvectors, so their sums follow exactly
+// from the trait's: sum Y^2 = ||y||^2 - ||U^T y||^2, sum X*Y = 1^T y - X^T Y
+// and sum X^2 = n - ||U^T 1||^2
+static EigenvalueGroup remainder_group(const Evd& evd, const double* trait, const double* Y,
+                                       const std::vector<double>& X) {
+    EigenvalueGroup group;
+    if (evd.num_remainder() == 0) {
+        return group;
+    }
+
+    size_t n_subjects = evd.num_subjects();
+    double trait_sum = 0.0, trait_squares = 0.0;
+    for (size_t i = 0; i < n_subjects; i++) {
+        trait_sum += trait[i];
+        trait_squares += trait[i] * trait[i];
+    }
+    double projected_squares = 0.0, projected_xy = 0.0, projected_xx = 0.0;
+    for (size_t c = 0; c < X.size(); c++) {
+        projected_squares += Y[c] * Y[c];
+        projected_xy += X[c] * Y[c];
+        projected_xx += X[c] * X[c];
+    }
+
+    group.value = evd.remainder_value;
+    group.count = static_cast<double>(evd.num_remainder());
+    group.yy = std::max(trait_squares - projected_squares, 0.0);
+    group.xy = trait_sum - projected_xy;
+    group.xx = std::max(n_subjects - projected_xx, 0.0);
+    return group;
+}
+
+// Fit FPHI to a trait that is already projected onto the eigenvectors
+// (Y = U^T * trait, X = U^T * ones, aux = [ones, eigenvalues]; group holds
+// any components of a low-rank EVD that are not stored)
+static FphiResult fit_projected_trait(const std::string& trait_name,
+                                      const std::vector<double>& Y,
+                                      const std::vector<double>& X,
+                                      const std::vector<std::vector<double>>& aux,
+                                      const EigenvalueGroup& group = EigenvalueGroup()) {
+    size_t n_subjects = Y.size();
+    double n_total = n_subjects + group.count;
+
+    FphiResult result;
+    result.trait = trait_name;
+    result.n_subjects = static_cast<size_t>(n_total);
+
+    // Call find_max_loglik_2 exactly like SOLAR (line 1096)
+    double result_variance;
+    result.h2r = find_max_loglik_2(11, Y, aux, X, group, result.loglik, result_variance, result.h2r_se,
+                                   result.mean, result.mean_se, result.e2, result.e2_se,
+                                   result.sd, result.sd_se);
+
+    // Calculate null model for p-value (lines 1104-1107)
+    double residual_sum_sq = 0.0;
+    for (double y : Y) {
+        residual_sum_sq += y * y;
+    }
+    residual_sum_sq += group.yy;
+    double null_variance = residual_sum_sq / n_total;
+    std::vector<double> ones(n_subjects, 1.0);
+    result.sporadic_loglik = calculate_fphi_loglik(null_variance, ones, n_total);
+
+    // Calculate p-value using likelihood ratio test
+    if (result.sporadic_loglik < result.loglik) {
+        double chi_stat = 2.0 * (result.loglik - result.sporadic_loglik);
+        result.pvalue = chicdf(chi_stat, 1.0);
+    } else {
+        result.pvalue = 0.5;  // Non-significant result
+    }
+
+    return result;
+}
+
+static void write_results_row(std::ostream& out, const FphiResult& r) {
+    out << std::fixed << std::setprecision(11);  // decimal places for file output
+    out << r.trait << "," << r.h2r << "," << r.h2r_se << ","
+        << r.loglik << "," << r.sporadic_loglik << ",";
+    if (r.pvalue < 1e-6) {
+        out << std::scientific << std::setprecision(11) << r.pvalue;
+    } else {
+        out << std::fixed << std::setprecision(6) << r.pvalue;
+    }
+    out << "," << r.n_subjects << std::endl;
+}
+
+static void write_results_file(const std::string& output_file, const std::vector<FphiResult>& results) {
+    std::ofstream results_stream(output_file);
+    if (results_stream) {
+        results_stream << "Trait,h2r,SE,loglik,sporadic_loglik,p_value,n_subjects" << std::endl;
+        for (const auto& r : results) {
+            write_results_row(results_stream, r);
+        }
+        results_stream.close();
+    }
+}
+
 int Fphi::run_fphi(
-    Pedigree* pedigree,
+    const Pedigree* pedigree,
     Phenotypes* phenotypes,
     const std::string& trait_name,
     const char* evd_data_basename
@@ -488,6 +742,21 @@ int Fphi::run_fphi(
         return 1;
     }
 
+    Evd evd;
+    if (read_evd_files(evd_data_basename, evd) != 0) {
+        return 1;
+    }
+    return run_fphi(pedigree, phenotypes, trait_name, evd, evd_data_basename);
+}
+
+int Fphi::run_fphi(
+    const Pedigree* pedigree,
+    Phenotypes* phenotypes,
+    const std::string& trait_name,
+    const Evd& evd,
+    const char* output_basename,
+    std::vector<FphiResult>* results_out
+) {
     if (!pedigree) {
         CERR << "Error: No pedigree loaded" << std::endl;
         return 1;
@@ -503,230 +772,230 @@ int Fphi::run_fphi(
         return 1;
     }
 
-    // Extract output directory from evd_data_basename
-    std::string output_dir = extract_directory(evd_data_basename);
-    
-    // Check that required EVD files exist (matching original structure)
-    std::string ids_file = std::string(evd_data_basename) + ".ids";
-    std::string eigenvals_file = std::string(evd_data_basename) + ".eigenvalues";
-    std::string eigenvecs_file = std::string(evd_data_basename) + ".eigenvectors";
-    std::string notes_file = std::string(evd_data_basename) + ".notes";
-    
-    // Try to read IDs file
-    std::ifstream ids_stream(ids_file);
-    if (!ids_stream) {
-        CERR << "Error: Cannot read EVD IDs file: " << ids_file << std::endl;
-        CERR << "Make sure create_evd_data has been run first" << std::endl;
-        return 1;
-    }
-    
-    std::vector<std::string> ids;
-    std::string line;
-    if (std::getline(ids_stream, line)) {
-        std::stringstream ss(line);
-        std::string id;
-        while (ss >> id) {
-            ids.push_back(id);
-        }
-    }
-    ids_stream.close();
-    
-    if (ids.empty()) {
+    if (evd.ids.empty()) {
         CERR << "Error: No IDs found in EVD data" << std::endl;
         return 1;
     }
-    
-    size_t n_subjects = ids.size();
-    
-    // Try to read eigenvalues
-    std::ifstream eigenvals_stream(eigenvals_file);
-    if (!eigenvals_stream) {
-        CERR << "Error: Cannot read eigenvalues file: " << eigenvals_file << std::endl;
-        return 1;
-    }
-    
-    std::vector<double> eigenvalues;
-    if (std::getline(eigenvals_stream, line)) {
-        std::stringstream ss(line);
-        std::string val_str;
-        while (ss >> val_str) {
-            try {
-                double val = std::stod(val_str);
-                eigenvalues.push_back(val);
-            } catch (const std::exception&) {
-                CERR << "Error: Invalid eigenvalue: " << val_str << std::endl;
-                return 1;
-            }
-        }
-    }
-    eigenvals_stream.close();
-    
-    if (eigenvalues.size() != n_subjects) {
-        CERR << "Error: Mismatch between number of IDs (" << n_subjects 
-                  << ") and eigenvalues (" << eigenvalues.size() << ")" << std::endl;
-        return 1;
-    }
-    
-    // Read eigenvectors matrix
-    std::ifstream eigenvecs_stream(eigenvecs_file);
-    if (!eigenvecs_stream) {
-        CERR << "Error: Cannot read eigenvectors file: " << eigenvecs_file << std::endl;
-        return 1;
-    }
-    
-    std::vector<std::vector<double>> eigenvectors(n_subjects, std::vector<double>(n_subjects));
-    if (std::getline(eigenvecs_stream, line)) {
-        std::stringstream ss(line);
-        std::string val_str;
-        size_t idx = 0;
-        
-        // Read eigenvectors in column-major order (as written by create_evd)
-        for (size_t col = 0; col < n_subjects && idx < n_subjects * n_subjects; col++) {
-            for (size_t row = 0; row < n_subjects && ss >> val_str; row++, idx++) {
-                try {
-                    eigenvectors[row][col] = std::stod(val_str);
-                } catch (const std::exception&) {
-                    CERR << "Error: Invalid eigenvector value: " << val_str << std::endl;
-                    return 1;
-                }
-            }
-        }
-    }
-    eigenvecs_stream.close();
-
-    // Get phenotype data for the current trait
-    const auto& data = phenotypes->get_data();
-    const auto& headers = phenotypes->get_headers();
 
-    // Find trait column
-    int trait_col = -1;
-    int id_col = -1;
+    const std::vector<std::string>& ids = evd.ids;
+    std::vector<double> eigenvalues = evd.eigenvalues();
 
-    for (size_t i = 0; i < headers.size(); i++) {
-        if (headers[i] == "id" || headers[i] == "ID") {
-            id_col = i;
-        }
-        if (headers[i] == trait_name) {
-            trait_col = i;
-        }
-    }
+    size_t n_subjects = ids.size();
 
-    if (id_col == -1 || trait_col == -1) {
-        CERR << "Error: Cannot find required columns in phenotype data" << std::endl;
+    // Find trait column
+    std::vector<const double*> trait_columns;
+    if (find_trait_columns(phenotypes, {trait_name}, trait_columns) != 0) {
         return 1;
     }
-    
+    const double* trait_column = trait_columns[0];
+
     // Extract phenotype values matching our IDs in the same order
-    std::vector<double> raw_phenotype_values(n_subjects);
+    Eigen::VectorXd raw_phenotype_values(n_subjects);
     bool found_all = true;
-    
+
     for (size_t i = 0; i < n_subjects; i++) {
         bool found = false;
-        for (const auto& row : data) {
-            if (row.size() > std::max(id_col, trait_col) && row[id_col] == ids[i]) {
-                const std::string& trait_val = row[trait_col];
-                if (!trait_val.empty() && trait_val != "NA" && trait_val != ".") {
-                    try {
-                        raw_phenotype_values[i] = std::stod(trait_val);
-                        found = true;
-                        break;
-                    } catch (const std::exception&) {
-                        // Invalid value
-                    }
-                }
-            }
+        int r = phenotypes->find_row(ids[i]);
+        if (r != -1 && !std::isnan(trait_column[r])) {
+            raw_phenotype_values[i] = trait_column[r];
+            found = true;
         }
         if (!found) {
             CERR << "Error: Cannot find phenotype value for ID: " << ids[i] << std::endl;
             found_all = false;
         }
     }
-    
+
     if (!found_all) {
         return 1;
     }
-    
+
     // Create matrices exactly like SOLAR (lines 1091-1093)
     // Y = eigenvectors_transpose * trait_v (NO mean subtraction like SOLAR line 1092)
-    std::vector<double> Y(n_subjects, 0.0);
-    for (size_t i = 0; i < n_subjects; i++) {
-        for (size_t j = 0; j < n_subjects; j++) {
-            Y[i] += eigenvectors[j][i] * raw_phenotype_values[j];  // eigenvectors^T * trait_v
-        }
-    }
-    
     // X = eigenvectors_transpose * cov_matrix (X is all ones for intercept only)
-    std::vector<double> X(n_subjects, 0.0);
-    for (size_t i = 0; i < n_subjects; i++) {
-        for (size_t j = 0; j < n_subjects; j++) {
-            X[i] += eigenvectors[j][i] * 1.0;  // eigenvectors^T * ones
-        }
-    }
-    
+    // A low-rank EVD has fewer components than subjects
+    size_t n_components = evd.num_components();
+    Eigen::VectorXd projected_trait = evd.project(raw_phenotype_values);
+    Eigen::VectorXd projected_ones = evd.project(Eigen::VectorXd::Ones(n_subjects));
+    std::vector<double> Y(projected_trait.data(), projected_trait.data() + n_components);
+    std::vector<double> X(projected_ones.data(), projected_ones.data() + n_components);
+
     // aux matrix: [ones, eigenvalues] (lines 453-454)
-    std::vector<std::vector<double>> aux(n_subjects, std::vector<double>(2));
-    for (size_t i = 0; i < n_subjects; i++) {
+    std::vector<std::vector<double>> aux(n_components, std::vector<double>(2));
+    for (size_t i = 0; i < n_components; i++) {
         aux[i][0] = 1.0;
         aux[i][1] = eigenvalues[i];
     }
-    
-    // Call find_max_loglik_2 exactly like SOLAR (line 1096)
-    double result_loglik, result_variance, result_se;
-    double result_mean, result_mean_se, result_e2, result_e2_se, result_sd, result_sd_se;
-    double h2r = find_max_loglik_2(11, Y, aux, X, result_loglik, result_variance, result_se,
-                                  result_mean, result_mean_se, result_e2, result_e2_se,
-                                  result_sd, result_sd_se);
-    double loglik = result_loglik;
-    
-    // Calculate null model for p-value (lines 1104-1107)
-    double residual_sum_sq = 0.0;
-    for (double y : Y) {
-        residual_sum_sq += y * y;
+
+    EigenvalueGroup group = remainder_group(evd, raw_phenotype_values.data(), Y.data(), X);
+    FphiResult result = fit_projected_trait(trait_name, Y, X, aux, group);
+    if (results_out) {
+        results_out->push_back(result);
     }
-    double null_variance = residual_sum_sq / n_subjects;
-    std::vector<double> ones(n_subjects, 1.0);
-    double sporadic_loglik = calculate_fphi_loglik(null_variance, ones, n_subjects);
-    
-    // Calculate p-value using likelihood ratio test
-    double pvalue;
-    if (sporadic_loglik < loglik) {
-        double chi_stat = 2.0 * (loglik - sporadic_loglik);
-        pvalue = chicdf(chi_stat, 1.0);
-    } else {
-        pvalue = 0.5;  // Non-significant result
+
+    if (!output_basename) {
+        return 0;
     }
-    
+
     // Create output file
-    std::string output_file = std::string(evd_data_basename) + "_fphi_results.out";
-    std::ofstream results_stream(output_file);
-    if (results_stream) {
-        results_stream.precision(11);  // decimal places for file output
-        results_stream << std::fixed;  // Force fixed-point notation
-        results_stream << "Trait,h2r,SE,loglik,sporadic_loglik,p_value,n_subjects" << std::endl;
-        results_stream << trait_name << "," << h2r << "," << result_se << "," 
-                      << loglik << "," << sporadic_loglik << ",";
-        if (pvalue < 1e-6) {
-            results_stream << std::scientific << std::setprecision(11) << pvalue;
-        } else {
-            results_stream << std::fixed << std::setprecision(6) << pvalue;
-        }
-        results_stream << "," << n_subjects << std::endl;
-        results_stream.close();
-    }
+    write_results_file(std::string(output_basename) + "_fphi_results.out", {result});
 
     // Create detailed parameters CSV file
-    std::string params_file = std::string(evd_data_basename) + "_parameters.out";
+    std::string params_file = std::string(output_basename) + "_parameters.out";
     std::ofstream params_stream(params_file);
     if (params_stream) {
         params_stream.precision(11);
         params_stream << std::fixed;
         params_stream << "Parameter,Value,SE" << std::endl;
-        params_stream << "mean," << result_mean << "," << result_mean_se << std::endl;
-        params_stream << "e2," << result_e2 << "," << result_e2_se << std::endl;
-        params_stream << "h2r," << h2r << "," << result_se << std::endl;
-        params_stream << "sd," << result_sd << "," << result_sd_se << std::endl;
+        params_stream << "mean," << result.mean << "," << result.mean_se << std::endl;
+        params_stream << "e2," << result.e2 << "," << result.e2_se << std::endl;
+        params_stream << "h2r," << result.h2r << "," << result.h2r_se << std::endl;
+        params_stream << "sd," << result.sd << "," << result.sd_se << std::endl;
         params_stream.close();
     }
 
     return 0;
 }
+
+int Fphi::run_fphi_batch(
+    const Pedigree* pedigree,
+    Phenotypes* phenotypes,
+    const std::vector<std::string>& trait_names,
+    const char* evd_data_basename
+) {
+    if (!evd_data_basename) {
+        CERR << "Error: No EVD data filename specified" << std::endl;
+        return 1;
+    }
+
+    Evd evd;
+    if (read_evd_files(evd_data_basename, evd) != 0) {
+        return 1;
+    }
+    return run_fphi_batch(pedigree, phenotypes, trait_names, evd, evd_data_basename);
+}
+
+int Fphi::run_fphi_batch(
+    const Pedigree* pedigree,
+    Phenotypes* phenotypes,
+    const std::vector<std::string>& trait_names,
+    const Evd& evd,
+    const char* output_basename,
+    std::vector<FphiResult>* results_out
+) {
+    if (!pedigree) {
+        CERR << "Error: No pedigree loaded" << std::endl;
+        return 1;
+    }
+
+    if (!phenotypes) {
+        CERR << "Error: No phenotype file is currently loaded" << std::endl;
+        return 1;
+    }
+
+    if (trait_names.empty()) {
+        CERR << "Error: No traits given for batch analysis" << std::endl;
+        return 1;
+    }
+
+    if (evd.ids.empty()) {
+        CERR << "Error: No IDs found in EVD data" << std::endl;
+        return 1;
+    }
+
+    const std::vector<std::string>& ids = evd.ids;
+    std::vector<double> eigenvalues = evd.eigenvalues();
+
+    size_t n_subjects = ids.size();
+    size_t n_traits = trait_names.size();
+
+    std::vector<const double*> trait_columns;
+    if (find_trait_columns(phenotypes, trait_names, trait_columns) != 0) {
+        return 1;
+    }
+
+    // Map each EVD subject to its phenotype row once
+    std::vector<size_t> subject_rows(n_subjects);
+    for (size_t i = 0; i < n_subjects; i++) {
+        int r = phenotypes->find_row(ids[i]);
+        if (r == -1) {
+            CERR << "Error: Cannot find phenotype row for ID: " << ids[i] << std::endl;
+            return 1;
+        }
+        subject_rows[i] = r;
+    }
+
+    // Shared design: X = U^T * ones, aux = [ones, eigenvalues]
+    size_t n_components = evd.num_components();
+    Eigen::VectorXd projected_ones = evd.project(Eigen::VectorXd::Ones(n_subjects));
+    std::vector<double> X(projected_ones.data(), projected_ones.data() + n_components);
+    std::vector<std::vector<double>> aux(n_components, std::vector<double>(2));
+    for (size_t i = 0; i < n_components; i++) {
+        aux[i][0] = 1.0;
+        aux[i][1] = eigenvalues[i];
+    }
+
+    // Project and fit traits a block at a time so U^T * Y stays a matrix
+    // multiply while memory stays bounded at n_subjects * block_size
+    const size_t block_size = 512;
+    std::vector<FphiResult> results(n_traits);
+    Eigen::MatrixXd trait_block(n_subjects, std::min(block_size, n_traits));
+    Eigen::MatrixXd projected_block;
+
+    for (size_t start = 0; start < n_traits; start += block_size) {
+        size_t width = std::min(block_size, n_traits - start);
+
+        for (size_t c = 0; c < width; c++) {
+            const double* trait_column = trait_columns[start + c];
+            for (size_t i = 0; i < n_subjects; i++) {
+                trait_block(i, c) = trait_column[subject_rows[i]];
+                if (std::isnan(trait_block(i, c))) {
+                    CERR << "Error: Cannot find phenotype value for ID: " << ids[i]
+                         << " (trait '" << trait_names[start + c] << "')" << std::endl;
+                    return 1;
+                }
+            }
+        }
+
+        projected_block = evd.project(trait_block.leftCols(width));
+
+        parallel_for(width, [&](size_t c) {
+            const double* column = projected_block.col(c).data();
+            std::vector<double> Y(column, column + n_components);
+            EigenvalueGroup group = remainder_group(evd, trait_block.col(c).data(), column, X);
+            results[start + c] = fit_projected_trait(trait_names[start + c], Y, X, aux, group);
+        });
+    }
+
+    COUT << "Fitted " << n_traits << " traits on " << n_subjects << " subjects" << std::endl;
+
+    if (results_out) {
+        results_out->insert(results_out->end(), results.begin(), results.end());
+    }
+
+    if (!output_basename) {
+        return 0;
+    }
+
+    write_batch_results(output_basename, results);
+    return 0;
+}
+
+void Fphi::write_batch_results(const char* output_basename, const std::vector<FphiResult>& results) {
+    write_results_file(std::string(output_basename) + "_fphi_results.out", results);
+
+    std::string params_file = std::string(output_basename) + "_parameters.out";
+    std::ofstream params_stream(params_file);
+    if (params_stream) {
+        params_stream.precision(11);
+        params_stream << std::fixed;
+        params_stream << "Trait,Parameter,Value,SE" << std::endl;
+        for (const auto& r : results) {
+            params_stream << r.trait << ",mean," << r.mean << "," << r.mean_se << std::endl;
+            params_stream << r.trait << ",e2," << r.e2 << "," << r.e2_se << std::endl;
+            params_stream << r.trait << ",h2r," << r.h2r << "," << r.h2r_se << std::endl;
+            params_stream << r.trait << ",sd," << r.sd << "," << r.sd_se << std::endl;
+        }
+        params_stream.close();
+    }
+}
@@ -8,22 +8,83 @@
 #define FPHI_H
 
 #include <string>
+#include <vector>
+#include <cstddef>
 
 // Forward declarations
 class Pedigree;
 class Phenotypes;
+class Evd;
+
+// Estimates for a single trait
+struct FphiResult {
+    std::string trait;
+    double h2r = 0.0;
+    double h2r_se = 0.0;
+    double loglik = 0.0;
+    double sporadic_loglik = 0.0;
+    double pvalue = 0.0;
+    size_t n_subjects = 0;
+    double mean = 0.0;
+    double mean_se = 0.0;
+    double e2 = 0.0;
+    double e2_se = 0.0;
+    double sd = 0.0;
+    double sd_se = 0.0;
+};
 
 class Fphi {
 public:
     // Run FPHI statistical analysis on EVD data with explicit parameters (no globals)
-    // Expects files: <basename>.ids, <basename>.eigenvalues, <basename>.eigenvectors
+    // Expects file: <basename>.evd
     // Creates: <basename>_fphi_results.out, <basename>_parameters.out
     static int run_fphi(
-        Pedigree* pedigree,
+        const Pedigree* pedigree,
         Phenotypes* phenotypes,
         const std::string& trait_name,
         const char* evd_data_basename
     );
+
+    // Run FPHI on an EVD already in memory (no .evd file is read)
+    // Creates: <output_basename>_fphi_results.out, <output_basename>_parameters.out
+    // unless output_basename is nullptr; the estimates are also appended
+    // to results when given
+    static int run_fphi(
+        const Pedigree* pedigree,
+        Phenotypes* phenotypes,
+        const std::string& trait_name,
+        const Evd& evd,
+        const char* output_basename,
+        std::vector<FphiResult>* results = nullptr
+    );
+
+    // Run FPHI for many traits sharing one EVD (all traits must be
+    // non-missing for every ID in <basename>.ids).
+    // Traits are projected in blocks with one U^T * Y multiply per block
+    // and fitted in parallel.
+    // Creates: <basename>_fphi_results.out (one row per trait),
+    //          <basename>_parameters.out (one row per trait and parameter)
+    static int run_fphi_batch(
+        const Pedigree* pedigree,
+        Phenotypes* phenotypes,
+        const std::vector<std::string>& trait_names,
+        const char* evd_data_basename
+    );
+
+    // Batch FPHI on an EVD already in memory; output_basename and results
+    // as for the in-memory run_fphi
+    static int run_fphi_batch(
+        const Pedigree* pedigree,
+        Phenotypes* phenotypes,
+        const std::vector<std::string>& trait_names,
+        const Evd& evd,
+        const char* output_basename,
+        std::vector<FphiResult>* results = nullptr
+    );
+
+    // Write <basename>_fphi_results.out and <basename>_parameters.out for
+    // batch results (one row per trait, in the order given)
+    static void write_batch_results(const char* output_basename, const std::vector<FphiResult>& results);
 };
 
 #endif // FPHI_H
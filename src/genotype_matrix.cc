@@ -0,0 +1,269 @@
+/*
+ * genotype_matrix.cc - PLINK and dosage genotypes, low-rank GRM decomposition
+ */
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <sstream>
+
+#include <Rcpp.h>
+#define COUT Rcpp::Rcout
+#define CERR Rcpp::Rcerr
+
+#include "Eigen/Dense"
+#include "genotype_matrix.h"
+#include "evd.h"
+#include "mapped_file.h"
+#include "parallel_for.h"
+
+// PLINK .bed magic number followed by the SNP-major mode byte
+static const unsigned char kBedMagic[3] = {0x6c, 0x1b, 0x01};
+
+// 2-bit .bed genotype codes: 00 homozygous first allele, 01 missing,
+// 10 heterozygous, 11 homozygous second allele (as first-allele counts)
+static const double kBedCounts[4] = {2.0, std::numeric_limits<double>::quiet_NaN(), 1.0, 0.0};
+
+static uint64_t fnv_update(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int GenotypeMatrix::read_plink(const std::string& prefix, GenotypeMatrix& genotypes) {
+    genotypes = GenotypeMatrix();
+
+    // Subjects: the second (IID) field of each .fam line
+    std::string fam_path = prefix + ".fam";
+    std::ifstream fam(fam_path);
+    if (!fam) {
+        CERR << "Error: Cannot read PLINK file " << fam_path << std::endl;
+        return 1;
+    }
+    std::string line;
+    while (std::getline(fam, line)) {
+        std::istringstream fields(line);
+        std::string family, id;
+        if (!(fields >> family)) {
+            continue;  // Blank line
+        }
+        if (!(fields >> id)) {
+            CERR << "Error: Malformed line in " << fam_path << ": " << line << std::endl;
+            return 1;
+        }
+        genotypes.ids_.push_back(id);
+    }
+
+    // Markers: one per non-blank .bim line
+    std::string bim_path = prefix + ".bim";
+    std::ifstream bim(bim_path);
+    if (!bim) {
+        CERR << "Error: Cannot read PLINK file " << bim_path << std::endl;
+        return 1;
+    }
+    size_t n_markers = 0;
+    while (std::getline(bim, line)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos) {
+            n_markers++;
+        }
+    }
+
+    std::string bed_path = prefix + ".bed";
+    auto bed = MappedFile::open(bed_path);
+    if (!bed) {
+        CERR << "Error: Cannot read PLINK file " << bed_path << std::endl;
+        return 1;
+    }
+
+    size_t n = genotypes.ids_.size();
+    size_t bytes_per_marker = (n + 3) / 4;
+    if (bed->size() < sizeof(kBedMagic) || std::memcmp(bed->data(), kBedMagic, sizeof(kBedMagic)) != 0) {
+        CERR << "Error: Not a SNP-major PLINK .bed file: " << bed_path << std::endl;
+        return 1;
+    }
+    if (bed->size() != sizeof(kBedMagic) + n_markers * bytes_per_marker) {
+        CERR << "Error: " << bed_path << " does not match " << n << " subjects and "
+             << n_markers << " markers" << std::endl;
+        return 1;
+    }
+
+    // Unpack first-allele counts, one marker per column
+    genotypes.z_.resize(n * n_markers);
+    const unsigned char* packed = reinterpret_cast<const unsigned char*>(bed->data()) + sizeof(kBedMagic);
+    parallel_for(n_markers, [&](size_t j) {
+        const unsigned char* marker = packed + j * bytes_per_marker;
+        double* column = genotypes.z_.data() + j * n;
+        for (size_t i = 0; i < n; i++) {
+            column[i] = kBedCounts[(marker[i / 4] >> (2 * (i % 4))) & 3];
+        }
+    });
+
+    return genotypes.standardize(n_markers);
+}
+
+int GenotypeMatrix::from_dosages(const std::vector<std::string>& ids, const double* dosages, size_t n_markers,
+                                 GenotypeMatrix& genotypes) {
+    genotypes = GenotypeMatrix();
+    genotypes.ids_ = ids;
+    genotypes.z_.assign(dosages, dosages + ids.size() * n_markers);
+    return genotypes.standardize(n_markers);
+}
+
+int GenotypeMatrix::standardize(size_t n_markers) {
+    size_t n = ids_.size();
+    if (n == 0) {
+        CERR << "Error: No subjects in genotype data" << std::endl;
+        return 1;
+    }
+
+    index_.reserve(n);
+    for (const auto& id : ids_) {
+        size_t before = index_.size();
+        index_.intern(id);
+        if (index_.size() == before) {
+            CERR << "Error: Duplicate ID in genotype data: " << id << std::endl;
+            return 1;
+        }
+    }
+
+    // Center by 2p and scale by sqrt(2p(1 - p)); a missing call becomes 0
+    std::vector<char> keep(n_markers, 0);
+    parallel_for(n_markers, [&](size_t j) {
+        double* column = z_.data() + j * n;
+        double sum = 0.0;
+        size_t called = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (!std::isnan(column[i])) {
+                sum += column[i];
+                called++;
+            }
+        }
+        double p = called > 0 ? sum / (2.0 * called) : 0.0;
+        double variance = 2.0 * p * (1.0 - p);
+        if (!(variance > 0.0)) {
+            return;  // Monomorphic or never called
+        }
+        double mean = 2.0 * p;
+        double scale = 1.0 / std::sqrt(variance);
+        for (size_t i = 0; i < n; i++) {
+            column[i] = std::isnan(column[i]) ? 0.0 : (column[i] - mean) * scale;
+        }
+        keep[j] = 1;
+    });
+
+    // Close up the dropped columns
+    n_markers_ = 0;
+    for (size_t j = 0; j < n_markers; j++) {
+        if (keep[j]) {
+            if (n_markers_ != j) {
+                std::memmove(z_.data() + n_markers_ * n, z_.data() + j * n, n * sizeof(double));
+            }
+            n_markers_++;
+        }
+    }
+    z_.resize(n * n_markers_);
+    z_.shrink_to_fit();
+
+    if (n_markers_ == 0) {
+        CERR << "Error: No polymorphic markers in genotype data" << std::endl;
+        return 1;
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (const auto& id : ids_) {
+        hash = fnv_update(hash, id.data(), id.size() + 1);
+    }
+    fingerprint_ = fnv_update(hash, z_.data(), z_.size() * sizeof(double));
+    return 0;
+}
+
+int GenotypeMatrix::decompose(const std::vector<std::string>& ids, EigenSolverBackend solver, Evd& evd) const {
+    size_t n = ids.size();
+    size_t m = n_markers_;
+    if (n == 0) {
+        CERR << "Error: No subjects to decompose" << std::endl;
+        return 1;
+    }
+
+    std::vector<int> rows(n);
+    for (size_t i = 0; i < n; i++) {
+        rows[i] = index_.find(ids[i]);
+        if (rows[i] == IdDictionary::npos) {
+            CERR << "Error: ID " << ids[i] << " has no genotypes" << std::endl;
+            return 1;
+        }
+    }
+
+    // Rows of Z for the subjects, scaled so that Zs Zs^T is the GRM
+    double scale = 1.0 / std::sqrt(static_cast<double>(m));
+    Eigen::MatrixXd zs(n, m);
+    for (size_t j = 0; j < m; j++) {
+        const double* column = z_.data() + j * num_subjects();
+        for (size_t i = 0; i < n; i++) {
+            zs(i, j) = column[rows[i]] * scale;
+        }
+    }
+
+    // With fewer markers than subjects, Zs = Q R and GRM = Q (R R^T) Q^T,
+    // so only the m x m matrix R R^T is decomposed; otherwise the n x n
+    // GRM is formed directly, at the same O(n^2 m) as the QR would cost
+    Eigen::MatrixXd q;
+    Eigen::MatrixXd gram;
+    if (m < n) {
+        Eigen::HouseholderQR<Eigen::MatrixXd> qr(zs);
+        zs.resize(0, 0);
+        Eigen::MatrixXd r = qr.matrixQR().topRows(m).triangularView<Eigen::Upper>();
+        q = Eigen::MatrixXd::Identity(n, m);
+        qr.householderQ().applyThisOnTheLeft(q);
+        gram.noalias() = r * r.transpose();
+    } else {
+        gram.noalias() = zs * zs.transpose();
+    }
+
+    int k = static_cast<int>(gram.rows());
+    std::vector<double> gram_array(gram.data(), gram.data() + gram.size());
+    gram.resize(0, 0);
+    std::vector<double> values, vectors;
+    int info = EigenSolver::decompose(solver, k, gram_array, values, vectors);
+    if (info != 0) {
+        CERR << "Error: Eigendecomposition of the genotype GRM failed (code " << info << ")" << std::endl;
+        return 1;
+    }
+
+    // Eigenvalues at rounding level belong to the null space, whose
+    // eigenvalue is exactly 0 (values are ascending)
+    double largest = values.empty() ? 0.0 : std::fabs(values.back());
+    double tolerance = k * std::numeric_limits<double>::epsilon() * largest;
+    size_t first = 0;
+    while (first < values.size() && values[first] <= tolerance) {
+        first++;
+    }
+    size_t rank = values.size() - first;
+    if (rank == 0) {
+        CERR << "Error: Genotype GRM of the selected subjects is zero" << std::endl;
+        return 1;
+    }
+
+    Eigen::Map<const Eigen::MatrixXd> w(vectors.data(), k, k);
+    Eigen::MatrixXd u;
+    if (q.size() > 0) {
+        u.noalias() = q * w.rightCols(rank);
+    } else {
+        u = w.rightCols(rank);
+    }
+
+    evd = Evd();
+    evd.ids = ids;
+    evd.blocks.emplace_back();
+    EvdBlock& block = evd.blocks.back();
+    block.rows.resize(n);
+    std::iota(block.rows.begin(), block.rows.end(), 0);
+    block.values.assign(values.begin() + first, values.end());
+    block.vectors.assign(u.data(), u.data() + u.size());
+    evd.remainder_value = 0.0;
+    return 0;
+}
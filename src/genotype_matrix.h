@@ -0,0 +1,66 @@
+/*
+ * genotype_matrix.h - Standardized genotypes as a low-rank kinship source
+ *
+ * The genetic relationship matrix of m markers is GRM = Z Z^T / m, where
+ * column j of Z holds marker j's allele counts centered by 2 p_j and scaled
+ * by sqrt(2 p_j (1 - p_j)), missing calls set to the mean (0). Keeping Z
+ * instead of the n x n GRM, the decomposition for any subject set follows
+ * from a thin SVD of those rows of Z: a Householder QR of the n x m rows
+ * and an m x m eigenproblem for the triangle, O(n m^2) instead of the
+ * O(n^3) dense EVD when m < n. The GRM then has rank at most m, and its
+ * other eigenvalues are exactly 0: they are left out of the Evd as its
+ * remainder (Evd::remainder_value) and fitted as one group.
+ */
+
+#ifndef GENOTYPE_MATRIX_H
+#define GENOTYPE_MATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "eigen_solver.h"
+#include "id_dictionary.h"
+
+class Evd;
+
+class GenotypeMatrix {
+public:
+    // Read a PLINK binary fileset <prefix>.bed/.bim/.fam (SNP-major);
+    // subjects are the .fam IID column. Returns 0 on success, 1 on failure
+    static int read_plink(const std::string& prefix, GenotypeMatrix& genotypes);
+
+    // Standardize an n x n_markers column-major matrix of allele counts
+    // (0, 1 or 2; NaN for missing) whose row i is ids[i].
+    // Returns 0 on success, 1 on failure
+    static int from_dosages(const std::vector<std::string>& ids, const double* dosages, size_t n_markers,
+                            GenotypeMatrix& genotypes);
+
+    size_t num_subjects() const { return ids_.size(); }
+
+    // Markers in Z (monomorphic markers are dropped)
+    size_t num_markers() const { return n_markers_; }
+
+    bool contains(const std::string& id) const { return index_.contains(id); }
+
+    // Hash of the IDs and standardized genotypes, for cache keys
+    uint64_t fingerprint() const { return fingerprint_; }
+
+    // Decomposition of the GRM over ids (every one genotyped), with the
+    // null space as the remainder. Returns 0 on success, 1 on failure
+    int decompose(const std::vector<std::string>& ids, EigenSolverBackend solver, Evd& evd) const;
+
+private:
+    // Standardize the raw counts in z_ column by column, dropping markers
+    // with no variance, and set the fingerprint
+    int standardize(size_t n_markers);
+
+    std::vector<std::string> ids_;
+    IdDictionary index_;
+    std::vector<double> z_;  // num_subjects() x n_markers_, column-major
+    size_t n_markers_ = 0;
+    uint64_t fingerprint_ = 0;
+};
+
+#endif // GENOTYPE_MATRIX_H
@@ -0,0 +1,61 @@
+/*
+ * id_dictionary.cc - Subject ID interning implementation
+ */
+
+#include <cstring>
+
+#include "id_dictionary.h"
+
+int IdDictionary::intern(std::string_view id) {
+    auto it = index_.find(id);
+    if (it != index_.end()) {
+        return it->second;
+    }
+
+    int index = static_cast<int>(names_.size());
+    std::string_view stored = store(id);
+    names_.push_back(stored);
+    index_.emplace(stored, index);
+    return index;
+}
+
+int IdDictionary::find(std::string_view id) const {
+    auto it = index_.find(id);
+    return it != index_.end() ? it->second : npos;
+}
+
+void IdDictionary::reserve(size_t count) {
+    names_.reserve(count);
+    index_.reserve(count);
+}
+
+void IdDictionary::clear() {
+    chunks_.clear();
+    chunk_used_ = kChunkSize;
+    names_.clear();
+    index_.clear();
+}
+
+std::string_view IdDictionary::store(std::string_view id) {
+    if (id.empty()) {
+        return std::string_view();
+    }
+
+    // Oversized IDs get a chunk of their own (the next ID starts a new chunk)
+    if (id.size() > kChunkSize) {
+        chunks_.emplace_back(new char[id.size()]);
+        std::memcpy(chunks_.back().get(), id.data(), id.size());
+        chunk_used_ = kChunkSize;
+        return std::string_view(chunks_.back().get(), id.size());
+    }
+
+    if (chunk_used_ + id.size() > kChunkSize) {
+        chunks_.emplace_back(new char[kChunkSize]);
+        chunk_used_ = 0;
+    }
+
+    char* dest = chunks_.back().get() + chunk_used_;
+    std::memcpy(dest, id.data(), id.size());
+    chunk_used_ += id.size();
+    return std::string_view(dest, id.size());
+}
@@ -0,0 +1,60 @@
+/*
+ * id_dictionary.h - Subject ID interning
+ * Maps each distinct ID string to a dense integer (0, 1, 2, ... in order of
+ * first appearance) so joins between pedigree, phenotype and EVD stages are
+ * O(1) integer work instead of string scans
+ */
+
+#ifndef ID_DICTIONARY_H
+#define ID_DICTIONARY_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class IdDictionary {
+public:
+    static constexpr int npos = -1;
+
+    IdDictionary() = default;
+
+    // Views point into the arena, so copies would dangle
+    IdDictionary(const IdDictionary&) = delete;
+    IdDictionary& operator=(const IdDictionary&) = delete;
+    IdDictionary(IdDictionary&&) = default;
+    IdDictionary& operator=(IdDictionary&&) = default;
+
+    // Return the index of id, adding it if it has not been seen before
+    int intern(std::string_view id);
+
+    // Return the index of id, or npos if it is unknown
+    int find(std::string_view id) const;
+
+    bool contains(std::string_view id) const { return find(id) != npos; }
+
+    // ID string for an index (valid for the lifetime of the dictionary)
+    std::string_view name(int index) const { return names_[index]; }
+
+    size_t size() const { return names_.size(); }
+    bool empty() const { return names_.empty(); }
+
+    void reserve(size_t count);
+    void clear();
+
+private:
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    std::string_view store(std::string_view id);
+
+    // String arena: chunks never move once allocated, so views stay valid
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    size_t chunk_used_ = kChunkSize;
+
+    std::vector<std::string_view> names_;
+    std::unordered_map<std::string_view, int> index_;
+};
+
+#endif // ID_DICTIONARY_H
@@ -0,0 +1,208 @@
+/*
+ * kinship_matrix.cc - Sparse phi2 kinship matrix
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <zlib.h>
+
+#include <Rcpp.h>
+#define COUT Rcpp::Rcout
+#define CERR Rcpp::Rcerr
+
+#include "kinship_matrix.h"
+#include "parallel_for.h"
+
+namespace {
+    struct Entry {
+        int row;
+        int col;
+        double value;
+    };
+
+    // Parse "<ibdid1> <ibdid2> <kinship>"; returns false for other lines
+    bool parse_phi2_line(const char* line, long& id1, long& id2, double& value) {
+        char* end;
+        id1 = std::strtol(line, &end, 10);
+        if (end == line) return false;
+        line = end;
+        id2 = std::strtol(line, &end, 10);
+        if (end == line) return false;
+        line = end;
+        value = std::strtod(line, &end);
+        return end != line;
+    }
+}
+
+int KinshipMatrix::load(const std::string& phi2_path, const std::vector<int>& ibdids, KinshipMatrix& matrix) {
+    size_t n = ibdids.size();
+
+    // IBDID -> matrix row, -1 for subjects that are not selected
+    int max_ibdid = 0;
+    for (int ibdid : ibdids) {
+        max_ibdid = std::max(max_ibdid, ibdid);
+    }
+    std::vector<int> row_of(max_ibdid + 1, -1);
+    for (size_t i = 0; i < n; i++) {
+        row_of[ibdids[i]] = static_cast<int>(i);
+    }
+
+    gzFile phi2_file = gzopen(phi2_path.c_str(), "rt");
+    if (!phi2_file) {
+        CERR << "Error: Cannot open " << phi2_path << " file" << std::endl;
+        return 1;
+    }
+
+    // Keep entries between selected subjects while decompressing
+    std::vector<Entry> entries;
+    std::vector<size_t> counts(n + 1, 0);
+    char buffer[1024];
+    while (gzgets(phi2_file, buffer, sizeof(buffer))) {
+        long id1, id2;
+        double value;
+        if (!parse_phi2_line(buffer, id1, id2, value)) continue;
+        if (id1 < 1 || id2 < 1 || id1 > max_ibdid || id2 > max_ibdid) continue;
+
+        int row = row_of[id1];
+        int col = row_of[id2];
+        if (row < 0 || col < 0) continue;
+
+        entries.push_back({row, col, value});
+        counts[row + 1]++;
+        if (row != col) {
+            counts[col + 1]++;  // Stored symmetrically
+        }
+    }
+    gzclose(phi2_file);
+
+    // Counting sort into CSR, keeping file order within each row
+    matrix.row_offsets_.assign(n + 1, 0);
+    for (size_t i = 0; i < n; i++) {
+        matrix.row_offsets_[i + 1] = matrix.row_offsets_[i] + counts[i + 1];
+    }
+    matrix.columns_.resize(matrix.row_offsets_[n]);
+    matrix.values_.resize(matrix.row_offsets_[n]);
+
+    std::vector<size_t> next(matrix.row_offsets_.begin(), matrix.row_offsets_.end() - 1);
+    for (const Entry& e : entries) {
+        size_t k = next[e.row]++;
+        matrix.columns_[k] = e.col;
+        matrix.values_[k] = e.value;
+        if (e.row != e.col) {
+            k = next[e.col]++;
+            matrix.columns_[k] = e.row;
+            matrix.values_[k] = e.value;
+        }
+    }
+
+    // phi2.gz may list a pair in both orders: merge repeats in place, the
+    // last value winning, so products see each entry once
+    std::vector<int> owner(n, -1);
+    std::vector<size_t> slot(n);
+    size_t kept = 0;
+    for (size_t row = 0; row < n; row++) {
+        size_t first = matrix.row_offsets_[row];
+        size_t last = matrix.row_offsets_[row + 1];
+        matrix.row_offsets_[row] = kept;
+        for (size_t k = first; k < last; k++) {
+            int col = matrix.columns_[k];
+            if (owner[col] == static_cast<int>(row)) {
+                matrix.values_[slot[col]] = matrix.values_[k];
+                continue;
+            }
+            owner[col] = static_cast<int>(row);
+            slot[col] = kept;
+            matrix.columns_[kept] = col;
+            matrix.values_[kept] = matrix.values_[k];
+            kept++;
+        }
+    }
+    matrix.row_offsets_[n] = kept;
+    matrix.columns_.resize(kept);
+    matrix.values_.resize(kept);
+
+    return 0;
+}
+
+void KinshipMatrix::subset(const std::vector<int>& rows, KinshipMatrix& out) const {
+    std::vector<int> row_of(size(), -1);
+    for (size_t i = 0; i < rows.size(); i++) {
+        row_of[rows[i]] = static_cast<int>(i);
+    }
+
+    out.row_offsets_.assign(1, 0);
+    out.columns_.clear();
+    out.values_.clear();
+    for (int row : rows) {
+        for (size_t k = row_offsets_[row]; k < row_offsets_[row + 1]; k++) {
+            int col = row_of[columns_[k]];
+            if (col >= 0) {
+                out.columns_.push_back(col);
+                out.values_.push_back(values_[k]);
+            }
+        }
+        out.row_offsets_.push_back(out.columns_.size());
+    }
+}
+
+double KinshipMatrix::get(int row, int col) const {
+    double value = 0.0;
+    for (size_t k = row_offsets_[row]; k < row_offsets_[row + 1]; k++) {
+        if (columns_[k] == col) {
+            value = values_[k];
+        }
+    }
+    return value;
+}
+
+void KinshipMatrix::fill_dense(const std::vector<int>& rows, const std::vector<int>& position, double* out) const {
+    size_t m = rows.size();
+    std::fill(out, out + m * m, 0.0);
+
+    for (size_t j = 0; j < m; j++) {
+        int row = rows[j];
+        for (size_t k = row_offsets_[row]; k < row_offsets_[row + 1]; k++) {
+            int col = columns_[k];
+            int i = position[col];
+            if (i >= 0 && static_cast<size_t>(i) < m && rows[i] == col) {
+                out[j * m + i] = values_[k];
+            }
+        }
+    }
+}
+
+void KinshipMatrix::multiply(const double* x, size_t columns, double* y) const {
+    const size_t rows_per_chunk = 256;
+    size_t n = size();
+    size_t n_chunks = (n + rows_per_chunk - 1) / rows_per_chunk;
+    parallel_for(n_chunks, [&](size_t chunk) {
+        size_t last = std::min(n, (chunk + 1) * rows_per_chunk);
+        for (size_t row = chunk * rows_per_chunk; row < last; row++) {
+            double* out = y + row * columns;
+            std::fill(out, out + columns, 0.0);
+            for (size_t k = row_offsets_[row]; k < row_offsets_[row + 1]; k++) {
+                const double* in = x + static_cast<size_t>(columns_[k]) * columns;
+                double value = values_[k];
+                for (size_t c = 0; c < columns; c++) {
+                    out[c] += value * in[c];
+                }
+            }
+        }
+    });
+}
+
+double KinshipMatrix::trace() const {
+    double sum = 0.0;
+    for (size_t row = 0; row < size(); row++) {
+        sum += get(static_cast<int>(row), static_cast<int>(row));
+    }
+    return sum;
+}
+
+double KinshipMatrix::squared_norm() const {
+    double sum = 0.0;
+    for (double value : values_) {
+        sum += value * value;
+    }
+    return sum;
+}
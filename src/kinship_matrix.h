@@ -0,0 +1,51 @@
+/*
+ * kinship_matrix.h - Sparse (CSR) phi2 kinship matrix
+ * Holds only the entries between selected subjects, with both triangles
+ * stored so each row can be scattered into a dense block in one pass
+ */
+
+#ifndef KINSHIP_MATRIX_H
+#define KINSHIP_MATRIX_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class KinshipMatrix {
+public:
+    // Read phi2.gz keeping only entries whose row and column are both in
+    // ibdids (1-based phi2 indices); row i of the matrix is ibdids[i].
+    // Returns 0 on success, 1 on failure
+    static int load(const std::string& phi2_path, const std::vector<int>& ibdids, KinshipMatrix& matrix);
+
+    // Principal submatrix over rows (indices into this matrix): row i of
+    // out is rows[i], so one load serves several subject subsets
+    void subset(const std::vector<int>& rows, KinshipMatrix& out) const;
+
+    size_t size() const { return row_offsets_.empty() ? 0 : row_offsets_.size() - 1; }
+    size_t nnz() const { return columns_.size(); }
+
+    // Kinship between rows (0 when absent); O(row length)
+    double get(int row, int col) const;
+
+    // Scatter the principal submatrix over rows into out (rows.size()^2,
+    // column-major, zero-filled first). position[r] must give the index of
+    // r within rows for every r in rows; entries whose column is not in
+    // rows are skipped
+    void fill_dense(const std::vector<int>& rows, const std::vector<int>& position, double* out) const;
+
+    // y = K x for x and y of size() x columns, row-major (so each sparse
+    // entry touches one contiguous row of x); rows are split across threads
+    void multiply(const double* x, size_t columns, double* y) const;
+
+    // Sum of the diagonal, and of every squared entry (||K||_F^2)
+    double trace() const;
+    double squared_norm() const;
+
+private:
+    std::vector<size_t> row_offsets_;  // size() + 1 offsets into columns_/values_
+    std::vector<int> columns_;
+    std::vector<double> values_;
+};
+
+#endif // KINSHIP_MATRIX_H
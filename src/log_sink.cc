@@ -0,0 +1,61 @@
+/*
+ * log_sink.cc - Queue of diagnostics written by worker threads
+ */
+
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <Rcpp.h>
+#define COUT Rcpp::Rcout
+#define CERR Rcpp::Rcerr
+
+#include "log_sink.h"
+
+namespace {
+    // Static initialisation runs while R loads the shared library, which
+    // it does on its main thread
+    const std::thread::id main_thread = std::this_thread::get_id();
+
+    std::mutex queue_mutex;
+    std::vector<std::pair<LogSink::Stream, std::string>> queue;
+
+    void emit(LogSink::Stream stream, const std::string& line) {
+        if (stream == LogSink::Stream::Err) {
+            CERR << line << std::endl;
+        } else {
+            COUT << line << std::endl;
+        }
+    }
+}
+
+bool LogSink::on_main_thread() {
+    return std::this_thread::get_id() == main_thread;
+}
+
+void LogSink::write(Stream stream, const std::string& line) {
+    if (on_main_thread()) {
+        drain();
+        emit(stream, line);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    queue.emplace_back(stream, line);
+}
+
+void LogSink::drain() {
+    if (!on_main_thread()) {
+        return;
+    }
+
+    std::vector<std::pair<Stream, std::string>> pending;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        pending.swap(queue);
+    }
+    for (const auto& entry : pending) {
+        emit(entry.first, entry.second);
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * log_sink.h - Thread-safe diagnostics drained to R on the main thread
+ * Rcpp::Rcout/Rcerr call into R and must only be used from the R main
+ * thread. Worker threads write here instead; lines are queued and written
+ * out in order the next time the main thread drains the sink (parallel_for
+ * does so once every loop has finished).
+ */
+
+#ifndef LOG_SINK_H
+#define LOG_SINK_H
+
+#include <string>
+
+class LogSink {
+public:
+    enum class Stream { Out, Err };
+
+    // Write one line (no trailing newline) from any thread; on the main
+    // thread it is written at once, after anything already queued
+    static void write(Stream stream, const std::string& line);
+
+    static void info(const std::string& line) { write(Stream::Out, line); }
+    static void error(const std::string& line) { write(Stream::Err, line); }
+
+    // Write queued lines to Rcout/Rcerr; does nothing off the main thread
+    static void drain();
+
+    // True on the thread that loaded the package (R's main thread)
+    static bool on_main_thread();
+};
+
+#endif // LOG_SINK_H
@@ -0,0 +1,68 @@
+/*
+ * mapped_file.cc - Read-only memory-mapped file implementation
+ */
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->path_ = path;
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    file->size_ = static_cast<size_t>(st.st_size);
+    if (file->size_ > 0) {
+        void* addr = mmap(nullptr, file->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            file->data_ = static_cast<const char*>(addr);
+            file->mapped_ = true;
+        }
+    }
+    ::close(fd);
+
+    if (file->mapped_ || file->size_ == 0) {
+        return file;
+    }
+#endif
+
+    // Fallback: read the whole file
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return nullptr;
+    }
+    file->size_ = static_cast<size_t>(in.tellg());
+    file->buffer_.resize(file->size_);
+    in.seekg(0);
+    if (file->size_ > 0 && !in.read(file->buffer_.data(), file->size_)) {
+        return nullptr;
+    }
+    file->data_ = file->buffer_.data();
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
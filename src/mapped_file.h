@@ -0,0 +1,38 @@
+/*
+ * mapped_file.h - Read-only memory-mapped file
+ * Falls back to reading the whole file into memory where mmap is unavailable
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MappedFile {
+public:
+    // Map a file read-only; returns nullptr if it cannot be opened
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+private:
+    MappedFile() = default;
+
+    std::string path_;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<char> buffer_;  // Fallback storage when not mapped
+};
+
+#endif // MAPPED_FILE_H
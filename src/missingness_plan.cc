@@ -0,0 +1,109 @@
+/*
+ * missingness_plan.cc - Group batch traits by their missingness pattern
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+#include <Rcpp.h>
+#define COUT Rcpp::Rcout
+#define CERR Rcpp::Rcerr
+
+#include "missingness_plan.h"
+#include "create_evd.h"
+#include "parallel_for.h"
+#include "pedigree.h"
+#include "phenotypes.h"
+
+// Hash of the bitmap of rows where column is non-missing, 64 rows a word
+static uint64_t pattern_hash(const double* column, const std::vector<size_t>& rows) {
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t word = 0;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (!std::isnan(column[rows[i]])) {
+            word |= static_cast<uint64_t>(1) << (i % 64);
+        }
+        if (i % 64 == 63 || i + 1 == rows.size()) {
+            hash = (hash ^ word) * 1099511628211ULL;
+            hash ^= hash >> 29;
+            word = 0;
+        }
+    }
+    return hash;
+}
+
+static bool same_pattern(const double* a, const double* b, const std::vector<size_t>& rows) {
+    for (size_t row : rows) {
+        if (std::isnan(a[row]) != std::isnan(b[row])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int MissingnessPlan::plan(const Pedigree* pedigree,
+                          const Phenotypes* phenotypes,
+                          const std::vector<std::string>& traits,
+                          std::vector<TraitGroup>& groups) {
+    groups.clear();
+    if (!pedigree || !phenotypes) {
+        CERR << "Error: Pedigree and phenotypes must be loaded" << std::endl;
+        return 1;
+    }
+
+    std::vector<const double*> columns;
+    for (const auto& trait : traits) {
+        int index = phenotypes->find_trait(trait);
+        if (index == -1) {
+            CERR << "Error: Trait '" << trait << "' not found in phenotype data" << std::endl;
+            return 1;
+        }
+        columns.push_back(phenotypes->get_trait(index));
+    }
+
+    // Only rows that can reach an EVD (their ID is in the pedigree) count
+    // towards a pattern
+    const IdDictionary& pedigree_ids = pedigree->ids();
+    std::vector<size_t> rows;
+    for (size_t row = 0; row < phenotypes->num_rows(); row++) {
+        if (pedigree_ids.contains(phenotypes->row_id(row))) {
+            rows.push_back(row);
+        }
+    }
+
+    std::vector<uint64_t> hashes(traits.size());
+    parallel_for(traits.size(), [&](size_t t) {
+        hashes[t] = pattern_hash(columns[t], rows);
+    });
+
+    // Equal hashes are confirmed against the group's first trait
+    std::unordered_multimap<uint64_t, size_t> group_of_hash;
+    for (size_t t = 0; t < traits.size(); t++) {
+        size_t group = groups.size();
+        auto candidates = group_of_hash.equal_range(hashes[t]);
+        for (auto it = candidates.first; it != candidates.second; ++it) {
+            if (same_pattern(columns[t], columns[groups[it->second].positions[0]], rows)) {
+                group = it->second;
+                break;
+            }
+        }
+        if (group == groups.size()) {
+            groups.emplace_back();
+            group_of_hash.emplace(hashes[t], group);
+        }
+        groups[group].traits.push_back(traits[t]);
+        groups[group].positions.push_back(t);
+    }
+
+    // Traits of a group have the same non-missing rows, so the first
+    // trait alone selects the group's subjects
+    for (auto& group : groups) {
+        if (CreateEVD::select_subjects(pedigree, phenotypes, {group.traits[0]}, group.subjects) != 0) {
+            CERR << "Error: No subjects for trait '" << group.traits[0] << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
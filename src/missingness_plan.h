@@ -0,0 +1,37 @@
+/*
+ * missingness_plan.h - Group batch traits by their missingness pattern
+ * Every trait is fitted on the subjects that have a value for it, and
+ * traits missing exactly the same subjects can share one decomposition.
+ * The planner hashes a bitmap of each trait's non-missing phenotype rows
+ * (in parallel) and groups traits whose bitmaps match, so a batch needs
+ * one EVD per distinct pattern rather than one per trait.
+ */
+
+#ifndef MISSINGNESS_PLAN_H
+#define MISSINGNESS_PLAN_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Pedigree;
+class Phenotypes;
+
+// Traits with one missingness pattern and the subjects they share
+struct TraitGroup {
+    std::vector<std::string> traits;    // In batch order
+    std::vector<size_t> positions;      // Index of each trait in the batch
+    std::vector<std::string> subjects;  // EVD rows (CreateEVD::select_subjects for these traits)
+};
+
+class MissingnessPlan {
+public:
+    // Split traits into groups, ordered by their first trait (so group 0
+    // holds traits[0]). Returns 0 on success, 1 on failure
+    static int plan(const Pedigree* pedigree,
+                    const Phenotypes* phenotypes,
+                    const std::vector<std::string>& traits,
+                    std::vector<TraitGroup>& groups);
+};
+
+#endif // MISSINGNESS_PLAN_H
@@ -0,0 +1,88 @@
+/*
+ * number_parse.h - Locale-free numeric token parsing
+ * Shared by every ingest path (kinship, phenotypes) so missing-value
+ * handling is identical everywhere. Uses std::from_chars (correctly
+ * rounded, so values written with enough digits round-trip exactly) and
+ * falls back to strtod where the standard library has no floating-point
+ * from_chars; R always runs with LC_NUMERIC=C, so that path is locale-free
+ * too.
+ */
+
+#ifndef NUMBER_PARSE_H
+#define NUMBER_PARSE_H
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+
+enum class NumberStatus {
+    Ok,       // value holds the parsed number
+    Missing,  // empty, "NA", "." or NaN
+    Invalid   // anything that is not a complete number
+};
+
+// Token without surrounding whitespace
+inline std::string_view trim_token(std::string_view token) {
+    const char* whitespace = " \t\r\n";
+    size_t first = token.find_first_not_of(whitespace);
+    if (first == std::string_view::npos) {
+        return std::string_view();
+    }
+    return token.substr(first, token.find_last_not_of(whitespace) - first + 1);
+}
+
+// True for tokens that denote a missing value (whitespace is ignored)
+inline bool is_missing_token(std::string_view token) {
+    token = trim_token(token);
+    return token.empty() || token == "NA" || token == ".";
+}
+
+// Parse a whole token as a double. Surrounding whitespace and a leading
+// '+' are accepted; trailing characters or an infinite value make the
+// token Invalid.
+inline NumberStatus parse_number(std::string_view token, double& value) {
+    if (is_missing_token(token)) {
+        return NumberStatus::Missing;
+    }
+    token = trim_token(token);
+
+    const char* first = token.data();
+    const char* last = first + token.size();
+    if (*first == '+') {
+        first++;
+        if (first == last || *first == '-') {
+            return NumberStatus::Invalid;
+        }
+    }
+
+#if defined(__cpp_lib_to_chars)
+    std::from_chars_result result = std::from_chars(first, last, value);
+    if (result.ec != std::errc() || result.ptr != last) {
+        return NumberStatus::Invalid;
+    }
+#else
+    char buffer[128];
+    size_t length = last - first;
+    if (length >= sizeof(buffer)) {
+        return NumberStatus::Invalid;
+    }
+    std::memcpy(buffer, first, length);
+    buffer[length] = '\0';
+    char* end = nullptr;
+    value = std::strtod(buffer, &end);
+    if (end != buffer + length) {
+        return NumberStatus::Invalid;
+    }
+#endif
+
+    // Overflow and "inf" are not usable values; "nan" is treated as missing
+    if (std::isinf(value)) {
+        return NumberStatus::Invalid;
+    }
+    return std::isnan(value) ? NumberStatus::Missing : NumberStatus::Ok;
+}
+
+#endif // NUMBER_PARSE_H
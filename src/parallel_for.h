@@ -0,0 +1,94 @@
+/*
+ * parallel_for.h - Minimal work-sharing loop over std::thread
+ * Used for embarrassingly parallel per-trait work (no R API calls allowed
+ * inside the loop body, since it runs off the R main thread; write
+ * diagnostics through LogSink). Runs on the current ThreadPool when a
+ * session has made one current, otherwise on threads started per loop.
+ */
+
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "log_sink.h"
+#include "thread_pool.h"
+
+// Number of cores
+inline unsigned hardware_thread_count() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Number of worker threads to use when the caller does not specify one:
+// the size of the current pool, or every core
+inline unsigned default_thread_count() {
+    ThreadPool* pool = ThreadPool::current();
+    return pool ? pool->size() : hardware_thread_count();
+}
+
+// Run body(i) for every i in [0, count), handing out indices dynamically.
+// The first exception thrown by any body is rethrown on the calling thread.
+template <typename Body>
+void parallel_for(size_t count, Body body, unsigned nthreads = 0) {
+    ThreadPool* pool = ThreadPool::current();
+    if (pool && nthreads == 0) {
+        pool->run(count, std::ref(body));
+        LogSink::drain();
+        return;
+    }
+
+    if (ThreadPool::in_worker()) {
+        nthreads = 1;  // Already inside a parallel loop
+    } else if (nthreads == 0) {
+        nthreads = default_thread_count();
+    }
+    nthreads = static_cast<unsigned>(std::min<size_t>(nthreads, count));
+
+    if (nthreads <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                body(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                next = count;  // Stop handing out work
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads - 1);
+    for (unsigned t = 1; t < nthreads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    LogSink::drain();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+#endif // PARALLEL_FOR_H
@@ -0,0 +1,107 @@
+/*
+ * parallel_gzip.cc - Multithreaded in-process gzip writer
+ */
+
+#include <zlib.h>
+
+#include "parallel_gzip.h"
+#include "parallel_for.h"
+
+ParallelGzipWriter::ParallelGzipWriter(unsigned nthreads, size_t chunk_size, int level)
+    : nthreads_(nthreads),
+      chunk_size_(chunk_size > 0 ? chunk_size : 1),
+      level_(level) {
+}
+
+ParallelGzipWriter::~ParallelGzipWriter() {
+    if (file_) {
+        close();
+    }
+}
+
+int ParallelGzipWriter::open(const std::string& path) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        return 1;
+    }
+
+    // One chunk per thread of the loop that will compress them
+    batch_size_ = nthreads_ > 0 ? nthreads_ : default_thread_count();
+    chunks_.clear();
+    chunks_.reserve(batch_size_);
+    members_written_ = 0;
+    failed_ = false;
+    return 0;
+}
+
+void ParallelGzipWriter::write(const char* data, size_t size) {
+    if (!file_) {
+        return;
+    }
+    if (chunks_.empty() || chunks_.back().size() >= chunk_size_) {
+        if (chunks_.size() == batch_size_) {
+            flush_batch();
+        }
+        chunks_.emplace_back();
+        chunks_.back().reserve(chunk_size_);
+    }
+    chunks_.back().append(data, size);
+}
+
+void ParallelGzipWriter::flush_batch() {
+    std::vector<std::string> members(chunks_.size());
+    std::vector<char> compressed(chunks_.size(), 0);
+    parallel_for(chunks_.size(), [&](size_t i) {
+        compressed[i] = compress_chunk(chunks_[i], members[i]);
+    }, nthreads_);
+
+    for (size_t i = 0; i < members.size(); i++) {
+        if (!compressed[i] || std::fwrite(members[i].data(), 1, members[i].size(), file_) != members[i].size()) {
+            failed_ = true;
+        }
+    }
+    members_written_ += members.size();
+    chunks_.clear();
+}
+
+// Deflate text as one complete gzip member
+bool ParallelGzipWriter::compress_chunk(const std::string& text, std::string& out) const {
+    z_stream stream = {};
+    if (deflateInit2(&stream, level_, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    out.resize(deflateBound(&stream, text.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    stream.avail_in = static_cast<uInt>(text.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+
+    int status = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+int ParallelGzipWriter::close() {
+    if (!file_) {
+        return 1;
+    }
+
+    // An empty file still gets one (empty) member so it is valid gzip
+    if (chunks_.empty() && members_written_ == 0) {
+        chunks_.emplace_back();
+    }
+    if (!chunks_.empty()) {
+        flush_batch();
+    }
+
+    if (std::fclose(file_) != 0) {
+        failed_ = true;
+    }
+    file_ = nullptr;
+    chunks_.clear();
+    chunks_.shrink_to_fit();
+
+    return failed_ ? 1 : 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * parallel_gzip.h - Multithreaded in-process gzip writer
+ * Text is appended into fixed-size chunks; once there is a chunk for every
+ * thread, the batch is deflated by parallel_for (on the session's pool when
+ * one is current) as independent gzip members, which are written in order.
+ * The concatenated members are a standard multi-member gzip file (readable
+ * by gzip, zcat and zlib's gzread/gzgets).
+ */
+
+#ifndef PARALLEL_GZIP_H
+#define PARALLEL_GZIP_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class ParallelGzipWriter {
+public:
+    // nthreads = 0 uses the current thread pool (or every core without
+    // one); level is a zlib compression level
+    explicit ParallelGzipWriter(unsigned nthreads = 0, size_t chunk_size = 1 << 20, int level = 6);
+    ~ParallelGzipWriter();
+
+    ParallelGzipWriter(const ParallelGzipWriter&) = delete;
+    ParallelGzipWriter& operator=(const ParallelGzipWriter&) = delete;
+
+    // Returns 0 on success, 1 on failure
+    int open(const std::string& path);
+
+    // Append data (compresses a batch of chunks whenever one fills up)
+    void write(const char* data, size_t size);
+    void write(const std::string& text) { write(text.data(), text.size()); }
+
+    // Compress and write everything buffered, then close the file.
+    // Returns 0 on success, 1 if any chunk failed to compress or write
+    int close();
+
+private:
+    // Deflate the buffered chunks in parallel and write them in order
+    void flush_batch();
+    bool compress_chunk(const std::string& text, std::string& out) const;
+
+    unsigned nthreads_;
+    size_t chunk_size_;
+    int level_;
+
+    FILE* file_ = nullptr;
+    size_t batch_size_ = 1;            // Chunks compressed together
+    std::vector<std::string> chunks_;  // The last one is being filled
+    size_t members_written_ = 0;
+    bool failed_ = false;
+};
+
+#endif // PARALLEL_GZIP_H
@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 
+#include "id_dictionary.h"
+
 // Structure to hold individual pedigree statistics
 struct PedigreeStats {
     int nfam;       // Number of families
@@ -27,6 +29,12 @@ public:
     int num_individuals() const { return nind_; }
     int num_founders() const { return nfou_; }
 
+    // Subject IDs in pedindex order (index + 1 is the sequential IBDID)
+    const IdDictionary& ids() const { return ids_; }
+
+    // Family (connected component) number of each subject, by ID index
+    const std::vector<int>& family_ids() const { return family_ids_; }
+
     int id_len() const { return id_len_; }
     int sex_len() const { return sex_len_; }
 
@@ -65,6 +73,8 @@ private:
     int mztwin_len_;
     int hhid_len_;
     int famid_len_;
+    IdDictionary ids_;
+    std::vector<int> family_ids_;
 
     static int _Has_Sex;
 };
@@ -5,10 +5,11 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <cmath>
 #include <cctype>
 #include <algorithm>
-#include <queue>
 #include <iomanip>
+#include <cstdio>
 
 #include <Rcpp.h>
 #define COUT Rcpp::Rcout
@@ -17,6 +18,10 @@
 #include "pedigree_loader.h"
 #include "pedigree.h"
 #include "csv_reader.h"
+#include "number_parse.h"
+#include "union_find.h"
+#include "parallel_gzip.h"
+#include "parallel_for.h"
 
 // Helper function to construct output file path
 static std::string make_output_path(const std::string& filename, const std::string& output_dir) {
@@ -39,6 +44,11 @@ PedigreeLoader::Builder& PedigreeLoader::Builder::from_file(const std::string& f
     return *this;
 }
 
+PedigreeLoader::Builder& PedigreeLoader::Builder::from_table(const KinshipTable& table) {
+    table_ = &table;
+    return *this;
+}
+
 PedigreeLoader::Builder& PedigreeLoader::Builder::with_threshold(double threshold) {
     threshold_ = threshold;
     return *this;
@@ -55,6 +65,14 @@ PedigreeLoader::Builder& PedigreeLoader::Builder::with_format(PedigreeFormat for
 }
 
 bool PedigreeLoader::Builder::validate() const {
+    if (table_) {
+        if (table_->ida.size() != table_->idb.size() || (!table_->kin && !table_->ida.empty())) {
+            CERR << "Error: Kinship table columns have different lengths" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
     if (filename_.empty()) {
         CERR << "Error: Pedigree filename not specified" << std::endl;
         return false;
@@ -77,15 +95,16 @@ std::unique_ptr<PedigreeLoader> PedigreeLoader::Builder::build() {
     }
 
     return std::unique_ptr<PedigreeLoader>(
-        new PedigreeLoader(filename_, threshold_, output_dir_, format_)
+        new PedigreeLoader(filename_, table_, threshold_, output_dir_, format_)
     );
 }
 
 // === PedigreeLoader Implementation ===
 
-PedigreeLoader::PedigreeLoader(const std::string& filename, double threshold,
+PedigreeLoader::PedigreeLoader(const std::string& filename, const KinshipTable* table, double threshold,
                                const std::string& output_dir, PedigreeFormat format)
     : filename_(filename),
+      table_(table),
       threshold_(threshold),
       output_dir_(output_dir),
       format_(format) {
@@ -122,6 +141,11 @@ bool PedigreeLoader::is_empirical_format(const std::string& filename) {
 }
 
 std::unique_ptr<Pedigree> PedigreeLoader::load() {
+    // In-memory tables are always empirical kinships
+    if (table_) {
+        return load_kinship_table();
+    }
+
     // Determine format
     PedigreeFormat actual_format = format_;
     if (actual_format == PedigreeFormat::AUTO) {
@@ -141,6 +165,112 @@ std::unique_ptr<Pedigree> PedigreeLoader::load() {
     return nullptr;
 }
 
+// Rows parsed from one line-aligned byte range of a kinship file, or one
+// row range of a KinshipTable
+struct KinshipChunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    size_t first_row = 0;
+    size_t last_row = 0;
+    IdDictionary ids;                    // Chunk-local, in order of first appearance
+    std::vector<KinshipEntry> kinships;  // Kept rows; id1/id2 are chunk-local indices until merged
+    std::vector<std::pair<size_t, const char*>> invalid_lines;  // (record within the chunk, reason)
+    size_t num_lines = 0;
+};
+
+namespace {
+    // Enough chunks to keep every core busy, but none much under 4 MB
+    size_t count_chunks(size_t bytes) {
+        size_t by_size = bytes / (4u << 20);
+        size_t by_threads = 4 * static_cast<size_t>(default_thread_count());
+        return std::max<size_t>(1, std::min(by_size, by_threads));
+    }
+
+    // Cut rows into chunks.size() ranges, each ending just after a newline
+    void split_lines(std::string_view rows, std::vector<KinshipChunk>& chunks) {
+        const char* begin = rows.data();
+        const char* end = rows.data() + rows.size();
+        const char* start = begin;
+        for (size_t c = 0; c < chunks.size(); c++) {
+            const char* stop = end;
+            if (c + 1 < chunks.size()) {
+                stop = std::max(start, begin + rows.size() * (c + 1) / chunks.size());
+                if (stop > begin && stop < end && stop[-1] != '\n') {
+                    const void* newline = std::memchr(stop, '\n', end - stop);
+                    stop = newline ? static_cast<const char*>(newline) + 1 : end;
+                }
+            }
+            chunks[c].begin = start;
+            chunks[c].end = stop;
+            start = stop;
+        }
+    }
+
+    // Add one pair to a chunk, keeping it if it passes the threshold (or is a self row)
+    void add_kinship_row(KinshipChunk& chunk, std::string_view ida, std::string_view idb,
+                         double kinship, double threshold) {
+        // Intern IDA and IDB even when the row is dropped so every
+        // subject in the file becomes a person
+        int ida_index = chunk.ids.intern(ida);
+        int idb_index = chunk.ids.intern(idb);
+
+        // Check if kinship meets threshold and store
+        bool passes_threshold = false;
+        if (threshold == 0.0) {
+            passes_threshold = (kinship > 0.0);
+        } else {
+            passes_threshold = (kinship >= threshold);
+        }
+
+        if (passes_threshold || ida_index == idb_index) {
+            KinshipEntry entry;
+            entry.id1 = ida_index;
+            entry.id2 = idb_index;
+            entry.kinship = kinship;
+            chunk.kinships.push_back(entry);
+        }
+    }
+
+    // Parse one chunk of a kinship file
+    void parse_kinship_chunk(KinshipChunk& chunk, size_t max_col,
+                             int ida_col, int idb_col, int kin_col, double threshold) {
+        CSVReader reader(chunk.begin, chunk.end);
+        std::vector<std::string_view> fields;
+        while (reader.get_record(fields)) {
+            size_t line = chunk.num_lines++;
+
+            if (fields.size() <= max_col) {
+                chunk.invalid_lines.emplace_back(line, "insufficient fields");
+                continue;
+            }
+
+            double kinship;
+            if (parse_number(fields[kin_col], kinship) != NumberStatus::Ok) {
+                chunk.invalid_lines.emplace_back(line, "invalid kinship value");
+                continue;
+            }
+
+            add_kinship_row(chunk, fields[ida_col], fields[idb_col], kinship, threshold);
+        }
+    }
+
+    // Collect one row range of an in-memory kinship table
+    void collect_kinship_rows(KinshipChunk& chunk, const KinshipTable& table, double threshold) {
+        for (size_t row = chunk.first_row; row < chunk.last_row; row++) {
+            size_t line = chunk.num_lines++;
+
+            // NA (NaN) and infinite kinships are rejected like unparsable text
+            double kinship = table.kin[row];
+            if (!std::isfinite(kinship)) {
+                chunk.invalid_lines.emplace_back(line, "invalid kinship value");
+                continue;
+            }
+
+            add_kinship_row(chunk, table.ida[row], table.idb[row], kinship, threshold);
+        }
+    }
+}
+
 std::unique_ptr<Pedigree> PedigreeLoader::load_empirical_pedigree() {
     CSVReader reader(filename_);
     std::vector<std::string> header;
@@ -173,127 +303,113 @@ std::unique_ptr<Pedigree> PedigreeLoader::load_empirical_pedigree() {
         return nullptr;
     }
 
-    // Data structures for parsing
-    std::vector<EmpiricalPerson> people;
-    std::vector<KinshipEntry> kinships;
+    // Split the rows into line-aligned byte ranges and parse them in parallel
+    std::string_view rows = reader.remaining();
+    size_t max_col = std::max({ida_col, idb_col, kin_col});
+    std::vector<KinshipChunk> chunks(count_chunks(rows.size()));
+    split_lines(rows, chunks);
 
-    int line_num = 1;
-    std::vector<std::string> fields;
-    while (reader.get_record(fields)) {
-        line_num++;
+    parallel_for(chunks.size(), [&](size_t c) {
+        parse_kinship_chunk(chunks[c], max_col, ida_col, idb_col, kin_col, threshold_);
+    });
 
-        if (fields.size() <= static_cast<size_t>(std::max({ida_col, idb_col, kin_col}))) {
-            CERR << "Warning: Invalid line " << line_num << ": insufficient fields" << std::endl;
-            continue;
-        }
+    // Records start on line 2, after the header
+    return merge_kinship_chunks(chunks, 2, "line");
+}
 
-        std::string ida = fields[ida_col];
-        std::string idb = fields[idb_col];
-        double kinship = std::stod(fields[kin_col]);
+std::unique_ptr<Pedigree> PedigreeLoader::load_kinship_table() {
+    // Split rows into ranges of at least 128k pairs and collect them in parallel
+    size_t n_rows = table_->ida.size();
+    size_t by_size = n_rows / (128u << 10);
+    size_t by_threads = 4 * static_cast<size_t>(default_thread_count());
+    std::vector<KinshipChunk> chunks(std::max<size_t>(1, std::min(by_size, by_threads)));
+    for (size_t c = 0; c < chunks.size(); c++) {
+        chunks[c].first_row = n_rows * c / chunks.size();
+        chunks[c].last_row = n_rows * (c + 1) / chunks.size();
+    }
 
-        // Find or add IDA
-        int ida_index = -1, idb_index = -1;
-        for (size_t i = 0; i < people.size(); i++) {
-            if (people[i].original_id == ida) {
-                ida_index = i;
-                break;
-            }
-        }
-        if (ida_index == -1) {
-            EmpiricalPerson person;
-            person.original_id = ida;
-            person.sequential_id = people.size() + 1;
-            person.family_id = 0; // Will be set later
-            ida_index = people.size();
-            people.push_back(person);
-        }
+    parallel_for(chunks.size(), [&](size_t c) {
+        collect_kinship_rows(chunks[c], *table_, threshold_);
+    });
 
-        // Find or add IDB
-        for (size_t i = 0; i < people.size(); i++) {
-            if (people[i].original_id == idb) {
-                idb_index = i;
-                break;
-            }
+    return merge_kinship_chunks(chunks, 1, "row");
+}
+
+std::unique_ptr<Pedigree> PedigreeLoader::merge_kinship_chunks(std::vector<KinshipChunk>& chunks,
+                                                               size_t first_line, const char* unit) {
+    // Assign global indices in file order of first appearance: chunk by
+    // chunk, each chunk's IDs in its own first-appearance order
+    std::vector<EmpiricalPerson> people;
+    IdDictionary ids;
+    std::vector<std::vector<int>> global_index(chunks.size());
+    size_t line_num = first_line;
+    for (size_t c = 0; c < chunks.size(); c++) {
+        KinshipChunk& chunk = chunks[c];
+        for (const auto& invalid : chunk.invalid_lines) {
+            CERR << "Warning: Invalid " << unit << " " << line_num + invalid.first << ": " << invalid.second << std::endl;
         }
-        if (idb_index == -1) {
-            EmpiricalPerson person;
-            person.original_id = idb;
-            person.sequential_id = people.size() + 1;
-            person.family_id = 0; // Will be set later
-            idb_index = people.size();
-            people.push_back(person);
+        line_num += chunk.num_lines;
+
+        global_index[c].resize(chunk.ids.size());
+        for (size_t i = 0; i < chunk.ids.size(); i++) {
+            std::string_view id = chunk.ids.name(i);
+            int index = ids.intern(id);
+            if (index == static_cast<int>(people.size())) {
+                EmpiricalPerson person;
+                person.original_id = std::string(id);
+                person.sequential_id = people.size() + 1;
+                person.family_id = 0; // Will be set later
+                people.push_back(person);
+            }
+            global_index[c][i] = index;
         }
+        chunk.ids.clear();
+    }
 
-        // Check if kinship meets threshold and store
-        bool passes_threshold = false;
-        if (threshold_ == 0.0) {
-            passes_threshold = (kinship > 0.0);
-        } else {
-            passes_threshold = (kinship >= threshold_);
+    // Rewrite kept rows to sequential IDs and merge families from every chunk
+    ConcurrentDisjointSet concurrent_families(people.size());
+    parallel_for(chunks.size(), [&](size_t c) {
+        const std::vector<int>& to_global = global_index[c];
+        for (KinshipEntry& entry : chunks[c].kinships) {
+            int ida_index = to_global[entry.id1];
+            int idb_index = to_global[entry.id2];
+            entry.id1 = ida_index + 1;
+            entry.id2 = idb_index + 1;
+            concurrent_families.unite(ida_index, idb_index);
         }
+    });
+    DisjointSet families = concurrent_families.to_disjoint_set();
 
-        if (passes_threshold || ida_index == idb_index) {
-            KinshipEntry entry;
-            entry.id1 = people[ida_index].sequential_id;
-            entry.id2 = people[idb_index].sequential_id;
-            entry.kinship = kinship;
-            kinships.push_back(entry);
-        }
+    std::vector<std::vector<KinshipEntry>> kinships(chunks.size());
+    for (size_t c = 0; c < chunks.size(); c++) {
+        kinships[c] = std::move(chunks[c].kinships);
     }
 
-    // Assign families using BFS (connected components)
-    std::vector<bool> visited(people.size(), false);
-    int nfamilies = 0;
-
+    // Assign family IDs from the connected components, numbered in order of
+    // each family's first person (same numbering as a BFS over people)
+    std::vector<int> family_ids;
+    int nfamilies = families.label_sets(family_ids);
     for (size_t i = 0; i < people.size(); i++) {
-        if (!visited[i]) {
-            nfamilies++;
-
-            // BFS to find all connected people
-            std::queue<int> q;
-            q.push(i);
-            visited[i] = true;
-            people[i].family_id = nfamilies;
-
-            while (!q.empty()) {
-                int current = q.front();
-                q.pop();
-
-                // Find all kinship entries involving this person
-                for (const auto& k : kinships) {
-                    int other = -1;
-                    if (k.id1 == people[current].sequential_id) {
-                        other = k.id2;
-                    } else if (k.id2 == people[current].sequential_id) {
-                        other = k.id1;
-                    }
-
-                    if (other != -1) {
-                        // Find the person with this sequential_id
-                        for (size_t p = 0; p < people.size(); p++) {
-                            if (people[p].sequential_id == other && !visited[p]) {
-                                visited[p] = true;
-                                people[p].family_id = nfamilies;
-                                q.push(p);
-                            }
-                        }
-                    }
-                }
-            }
-        }
+        people[i].family_id = family_ids[i];
     }
 
     // Create output files
-    create_output_files(people, kinships, nfamilies);
+    if (create_output_files(people, kinships, nfamilies) != 0) {
+        return nullptr;
+    }
 
     // Load statistics from generated pedigree.info file
     auto pedigree = load_pedigree_info();
+    if (pedigree) {
+        pedigree->ids_ = std::move(ids);
+        pedigree->family_ids_ = std::move(family_ids);
+    }
 
     return pedigree;
 }
 
-void PedigreeLoader::create_output_files(const std::vector<EmpiricalPerson>& people,
-                                         const std::vector<KinshipEntry>& kinships,
+int PedigreeLoader::create_output_files(const std::vector<EmpiricalPerson>& people,
+                                         const std::vector<std::vector<KinshipEntry>>& kinships,
                                          int nfamilies) {
     // Find max ID length
     int max_id_len = 30; // minimum default
@@ -302,6 +418,12 @@ void PedigreeLoader::create_output_files(const std::vector<EmpiricalPerson>& peo
         if (len > max_id_len) max_id_len = len;
     }
 
+    // Count members per family (family IDs are 1-based)
+    std::vector<int> family_sizes(nfamilies, 0);
+    for (const auto& person : people) {
+        family_sizes[person.family_id - 1]++;
+    }
+
     // Create pedigree.info file
     std::string pedigree_info_path = make_output_path("pedigree.info", output_dir_);
     std::ofstream info_fp(pedigree_info_path);
@@ -309,9 +431,9 @@ void PedigreeLoader::create_output_files(const std::vector<EmpiricalPerson>& peo
         info_fp << filename_ << " empirical\n";
         info_fp << max_id_len << " 1 0 0 0\n"; // id_len, sex_len, mztwin_len, hhid_len, famid_len
         info_fp << nfamilies << " " << nfamilies << " " << people.size() << " " << nfamilies << "\n"; // nped, nfam, nind, nfou
-        info_fp << "1 1 1 0 n\n"; // family 1 info
-        if (nfamilies > 1) {
-            info_fp << "1 1 1 0 n\n"; // family 2 info (if exists)
+        // One line per family: nfam, nind, nfou (all founders), nlbrk, inbred
+        for (int size : family_sizes) {
+            info_fp << "1 " << size << " " << size << " 0 n\n";
         }
         info_fp.close();
     }
@@ -334,22 +456,32 @@ void PedigreeLoader::create_output_files(const std::vector<EmpiricalPerson>& peo
         pedindex_fp.close();
     }
 
-    // Create phi2 (kinship matrix)
-    std::string phi2_path = make_output_path("phi2", output_dir_);
-    std::ofstream phi2_fp(phi2_path);
-    if (phi2_fp.is_open()) {
-        int matrix_digits = 7;
+    // Create phi2.gz (kinship matrix), compressed in-process while formatting
+    std::string phi2_path = make_output_path("phi2.gz", output_dir_);
+    ParallelGzipWriter phi2_gz;
+    if (phi2_gz.open(phi2_path) != 0) {
+        CERR << "Error: Cannot create " << phi2_path << std::endl;
+        return 1;
+    }
 
-        for (const auto& k : kinships) {
-            phi2_fp << std::setw(matrix_digits) << k.id1 << " "
-                   << std::setw(matrix_digits) << k.id2 << " "
-                   << std::fixed << std::setprecision(7) << k.kinship << "\n";
+    char line[64];
+    for (const auto& chunk : kinships) {
+        for (const auto& k : chunk) {
+            int len = snprintf(line, sizeof(line), "%7d %7d %.7f\n", k.id1, k.id2, k.kinship);
+            if (len < 0 || static_cast<size_t>(len) >= sizeof(line)) {
+                // Only a kinship far outside any real range gets this long
+                CERR << "Error: Kinship " << k.kinship << " between IBDIDs " << k.id1 << " and " << k.id2
+                     << " is too large to write to " << phi2_path << std::endl;
+                phi2_gz.close();
+                return 1;
+            }
+            phi2_gz.write(line, len);
         }
-        phi2_fp.close();
+    }
 
-        // Create phi2.gz using system gzip
-        std::string gzip_cmd = "gzip -f " + phi2_path;
-        system(gzip_cmd.c_str());
+    if (phi2_gz.close() != 0) {
+        CERR << "Error: Failed writing " << phi2_path << std::endl;
+        return 1;
     }
 
     // Create pedindex.cde file
@@ -384,6 +516,8 @@ void PedigreeLoader::create_output_files(const std::vector<EmpiricalPerson>& peo
                      << nfamilies << "," << people.size() << "\n";
         solar_csv_fp.close();
     }
+
+    return 0;
 }
 
 std::unique_ptr<Pedigree> PedigreeLoader::load_pedigree_info() {
@@ -7,6 +7,7 @@
 #define PEDIGREE_LOADER_H
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include <vector>
 
@@ -14,6 +15,16 @@
 class Pedigree;
 struct EmpiricalPerson;
 struct KinshipEntry;
+struct KinshipChunk;
+
+// Kinship rows held in memory (e.g. an R data.frame): row i pairs ida[i]
+// with idb[i] at kinship kin[i]. Nothing is copied, so the referenced
+// memory must outlive PedigreeLoader::load()
+struct KinshipTable {
+    std::vector<std::string_view> ida;
+    std::vector<std::string_view> idb;
+    const double* kin = nullptr;
+};
 
 enum class PedigreeFormat {
     AUTO,       // Auto-detect format
@@ -27,6 +38,7 @@ public:
         Builder() = default;
 
         Builder& from_file(const std::string& filename);
+        Builder& from_table(const KinshipTable& table);
         Builder& with_threshold(double threshold);
         Builder& with_output_dir(const std::string& output_dir);
         Builder& with_format(PedigreeFormat format);
@@ -35,6 +47,7 @@ public:
 
     private:
         std::string filename_;
+        const KinshipTable* table_ = nullptr;
         double threshold_ = 0.0;
         std::string output_dir_;
         PedigreeFormat format_ = PedigreeFormat::AUTO;
@@ -47,10 +60,11 @@ public:
 
 private:
     // Only constructible via Builder
-    PedigreeLoader(const std::string& filename, double threshold,
+    PedigreeLoader(const std::string& filename, const KinshipTable* table, double threshold,
                    const std::string& output_dir, PedigreeFormat format);
 
     std::string filename_;
+    const KinshipTable* table_;
     double threshold_;
     std::string output_dir_;
     PedigreeFormat format_;
@@ -58,8 +72,11 @@ private:
     // Helper methods
     bool is_empirical_format(const std::string& filename);
     std::unique_ptr<Pedigree> load_empirical_pedigree();
-    void create_output_files(const std::vector<EmpiricalPerson>& people,
-                            const std::vector<KinshipEntry>& kinships,
+    std::unique_ptr<Pedigree> load_kinship_table();
+    std::unique_ptr<Pedigree> merge_kinship_chunks(std::vector<KinshipChunk>& chunks,
+                                                   size_t first_line, const char* unit);
+    int create_output_files(const std::vector<EmpiricalPerson>& people,
+                            const std::vector<std::vector<KinshipEntry>>& kinships,
                             int nfamilies);
     std::unique_ptr<Pedigree> load_pedigree_info();
 };
@@ -0,0 +1,304 @@
+/*
+ * phenotype_cache.cc - Phenotype sidecar reader and writer
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <Rcpp.h>
+#define COUT Rcpp::Rcout
+#define CERR Rcpp::Rcerr
+
+#include "phenotype_cache.h"
+#include "phenotypes.h"
+#include "mapped_file.h"
+
+static const char kCacheMagic[8] = {'S', 'O', 'L', 'A', 'R', 'P', 'H', 'N'};
+
+// Bytes hashed at each end of the CSV
+static const size_t kHashSpan = 64 * 1024;
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+// Same "id"/"ID" rule as Phenotypes::load_csv (the last match wins)
+static int find_id_column(const std::vector<std::string>& headers) {
+    int id_col = -1;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (headers[i] == "id" || headers[i] == "ID") {
+            id_col = i;
+        }
+    }
+    return id_col;
+}
+
+// Modification time in nanoseconds, so that a rewrite within the same
+// second still changes it (seconds only where stat has no finer field)
+static int64_t mtime_ns(const struct stat& st) {
+    const int64_t ns_per_second = 1000000000;
+#if defined(__APPLE__)
+    return static_cast<int64_t>(st.st_mtimespec.tv_sec) * ns_per_second + st.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * ns_per_second + st.st_mtim.tv_nsec;
+#else
+    return static_cast<int64_t>(st.st_mtime) * ns_per_second;
+#endif
+}
+
+// Size, modification time and content hash identifying one version of a CSV
+static int csv_key(const std::string& csv_path, uint64_t& size, int64_t& mtime, uint64_t& hash) {
+    struct stat st;
+    if (stat(csv_path.c_str(), &st) != 0) {
+        return 1;
+    }
+    mtime = mtime_ns(st);
+
+    auto file = MappedFile::open(csv_path);
+    if (!file) {
+        return 1;
+    }
+    const char* data = file->data();
+    size_t n = file->size();
+    size = n;
+
+    // Header line (however long) plus the first and last kHashSpan bytes
+    const void* newline = n > 0 ? std::memchr(data, '\n', n) : nullptr;
+    size_t header_end = newline ? static_cast<const char*>(newline) - data + 1 : n;
+    size_t head = std::max(header_end, std::min(n, kHashSpan));
+    size_t tail = std::max(head, n - std::min(n, kHashSpan));
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(head));
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data + tail), static_cast<uInt>(n - tail));
+    hash = crc;
+    return 0;
+}
+
+std::string PhenotypeCache::path_for(const std::string& csv_path) {
+    return csv_path + ".solarphen";
+}
+
+int PhenotypeCache::write(const Phenotypes& phenotypes, const std::string& csv_path) {
+    const std::vector<std::string>& headers = phenotypes.headers;
+    int id_col = find_id_column(headers);
+    size_t n_traits = headers.size() - (id_col != -1 ? 1 : 0);
+    if (phenotypes.trait_names.size() != n_traits) {
+        CERR << "Error: Phenotype cache needs every column of " << csv_path << " loaded" << std::endl;
+        return 1;
+    }
+
+    PhenotypeCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrderMark;
+    if (csv_key(csv_path, header.csv_size, header.csv_mtime, header.csv_hash) != 0) {
+        CERR << "Error: Cannot read phenotype file " << csv_path << std::endl;
+        return 1;
+    }
+    header.n_rows = phenotypes.num_rows();
+    header.n_columns = headers.size();
+    header.id_column = id_col;
+
+    // Lay out sections
+    uint64_t offset = sizeof(PhenotypeCacheHeader);
+    header.names_offset = offset;
+    for (const auto& name : headers) {
+        offset += sizeof(uint32_t) + name.size();
+    }
+    header.row_ids_offset = align8(offset);
+    offset = header.row_ids_offset;
+    for (size_t row = 0; row < header.n_rows; row++) {
+        offset += sizeof(int32_t) + phenotypes.row_id(row).size();
+    }
+    header.values_offset = align8(offset);
+    header.end_offset = header.values_offset + n_traits * header.n_rows * sizeof(double);
+
+    // Write beside the final path and rename, so readers never see a partial file
+    std::string path = path_for(csv_path);
+    std::string temp_path = path + ".tmp";
+    std::ofstream out(temp_path, std::ios::binary);
+    if (!out) {
+        CERR << "Error: Cannot create phenotype cache " << path << std::endl;
+        return 1;
+    }
+
+    static const char zeros[8] = {0};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    offset = sizeof(header);
+    for (const auto& name : headers) {
+        uint32_t length = static_cast<uint32_t>(name.size());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(name.data(), name.size());
+        offset += sizeof(length) + name.size();
+    }
+    out.write(zeros, header.row_ids_offset - offset);
+
+    offset = header.row_ids_offset;
+    for (size_t row = 0; row < header.n_rows; row++) {
+        std::string_view id = phenotypes.row_id(row);
+        int32_t length = phenotypes.row_ids[row] != IdDictionary::npos ? static_cast<int32_t>(id.size()) : -1;
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(id.data(), id.size());
+        offset += sizeof(length) + id.size();
+    }
+    out.write(zeros, header.values_offset - offset);
+
+    for (size_t t = 0; t < n_traits; t++) {
+        out.write(reinterpret_cast<const char*>(phenotypes.get_trait(t)), header.n_rows * sizeof(double));
+    }
+    out.close();
+
+    if (!out) {
+        CERR << "Error: Failed writing phenotype cache " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return 1;
+    }
+
+    std::remove(path.c_str());
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        CERR << "Error: Cannot create phenotype cache " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int PhenotypeCache::read(const std::string& csv_path, const std::vector<std::string>& columns,
+                         Phenotypes& phenotypes) {
+    std::string path = path_for(csv_path);
+    auto file = MappedFile::open(path);
+    if (!file) {
+        return 1;
+    }
+
+    const char* data = file->data();
+    uint64_t size = file->size();
+
+    PhenotypeCacheHeader header;
+    if (size < sizeof(header)) {
+        return 1;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+        header.byte_order != kByteOrderMark || header.version != kVersion) {
+        return 1;
+    }
+
+    // Stale if the CSV has changed since conversion
+    uint64_t csv_size;
+    int64_t csv_mtime;
+    uint64_t csv_hash;
+    if (csv_key(csv_path, csv_size, csv_mtime, csv_hash) != 0 ||
+        csv_size != header.csv_size || csv_mtime != header.csv_mtime || csv_hash != header.csv_hash) {
+        return 1;
+    }
+
+    uint64_t n_traits = header.n_columns - (header.id_column != -1 ? 1 : 0);
+    if (header.end_offset != size ||
+        header.id_column < -1 || header.id_column >= static_cast<int64_t>(header.n_columns) ||
+        header.names_offset > header.row_ids_offset ||
+        header.row_ids_offset > header.values_offset ||
+        header.values_offset + n_traits * header.n_rows * sizeof(double) != header.end_offset) {
+        CERR << "Warning: Ignoring invalid phenotype cache " << path << std::endl;
+        return 1;
+    }
+
+    // Column names
+    std::vector<std::string> headers;
+    headers.reserve(std::min<uint64_t>(header.n_columns, (header.row_ids_offset - header.names_offset) / sizeof(uint32_t)));
+    uint64_t offset = header.names_offset;
+    for (uint64_t i = 0; i < header.n_columns; i++) {
+        uint32_t length = 0;
+        if (offset + sizeof(length) <= header.row_ids_offset) {
+            std::memcpy(&length, data + offset, sizeof(length));
+        }
+        offset += sizeof(length);
+        if (offset + length > header.row_ids_offset) {
+            CERR << "Warning: Ignoring invalid phenotype cache " << path << std::endl;
+            return 1;
+        }
+        headers.emplace_back(data + offset, length);
+        offset += length;
+    }
+
+    // Requested columns, in file order; unknown names are left for the
+    // CSV loader to report
+    IdDictionary wanted;
+    IdDictionary header_names;
+    for (const auto& name : columns) {
+        wanted.intern(name);
+    }
+    for (const auto& name : headers) {
+        header_names.intern(name);
+    }
+    for (const auto& name : columns) {
+        if (!header_names.contains(name)) {
+            return 1;
+        }
+    }
+    std::vector<std::string> trait_names;
+    std::vector<const double*> column_data;
+    const double* values = reinterpret_cast<const double*>(data + header.values_offset);
+    uint64_t t = 0;
+    for (uint64_t i = 0; i < header.n_columns; i++) {
+        if (static_cast<int64_t>(i) == header.id_column) {
+            continue;
+        }
+        if (columns.empty() || wanted.contains(headers[i])) {
+            trait_names.push_back(headers[i]);
+            column_data.push_back(values + t * header.n_rows);
+        }
+        t++;
+    }
+
+    // Row IDs
+    IdDictionary ids;
+    std::vector<int> row_ids;
+    std::vector<int> id_rows;
+    uint64_t max_rows = (header.values_offset - header.row_ids_offset) / sizeof(int32_t);
+    ids.reserve(std::min(header.n_rows, max_rows));
+    row_ids.reserve(std::min(header.n_rows, max_rows));
+    offset = header.row_ids_offset;
+    for (uint64_t row = 0; row < header.n_rows; row++) {
+        int32_t length = 0;
+        if (offset + sizeof(length) <= header.values_offset) {
+            std::memcpy(&length, data + offset, sizeof(length));
+        }
+        offset += sizeof(length);
+        if (offset + std::max<int32_t>(length, 0) > header.values_offset) {
+            CERR << "Warning: Ignoring invalid phenotype cache " << path << std::endl;
+            return 1;
+        }
+
+        int index = IdDictionary::npos;
+        if (length >= 0) {
+            index = ids.intern(std::string_view(data + offset, length));
+            if (index == static_cast<int>(id_rows.size())) {
+                id_rows.push_back(row);
+            }
+            offset += length;
+        }
+        row_ids.push_back(index);
+    }
+
+    phenotypes.filename = csv_path;
+    phenotypes.headers = std::move(headers);
+    phenotypes.trait_names = std::move(trait_names);
+    phenotypes.index_traits();
+    phenotypes.columns.clear();
+    phenotypes.column_data = std::move(column_data);
+    phenotypes.storage = file;
+    phenotypes.has_id_col = (header.id_column != -1);
+    phenotypes.ids = std::move(ids);
+    phenotypes.row_ids = std::move(row_ids);
+    phenotypes.id_rows = std::move(id_rows);
+    return 0;
+}
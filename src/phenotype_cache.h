@@ -0,0 +1,67 @@
+/*
+ * phenotype_cache.h - Column-major binary sidecar for phenotype CSVs
+ *
+ * Very wide phenotype files (e.g. voxelwise traits) are converted once to
+ * <file>.solarphen; Phenotypes::load then maps the sidecar instead of
+ * tokenizing the CSV, and a trait subset only touches the pages of its
+ * own columns.
+ *
+ * Layout (native byte order, all sections 8-byte aligned):
+ *   header    PhenotypeCacheHeader
+ *   names     per CSV column: uint32 length + bytes
+ *   row IDs   per row: int32 length (-1 for a row without an ID) + bytes
+ *   values    float64, column-major: every non-ID column in file order,
+ *             n_rows values each, NaN for missing
+ *
+ * The cache is used only while the CSV's size, modification time (in
+ * nanoseconds where the file system records them) and a CRC-32 of its
+ * header line plus its first and last 64 KiB match the values recorded at
+ * conversion time. Only the size and modification time guard the middle
+ * of the file: an edit there that keeps both is not detected.
+ */
+
+#ifndef PHENOTYPE_CACHE_H
+#define PHENOTYPE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Phenotypes;
+
+struct PhenotypeCacheHeader {
+    char magic[8];            // "SOLARPHN"
+    uint32_t version;
+    uint32_t byte_order;      // kByteOrderMark as written by the producer
+    uint64_t csv_size;
+    int64_t csv_mtime;        // nanoseconds since the epoch
+    uint64_t csv_hash;
+    uint64_t n_rows;
+    uint64_t n_columns;       // CSV columns, including the ID column
+    int64_t id_column;        // -1 if the CSV has no ID column
+    uint64_t names_offset;
+    uint64_t row_ids_offset;
+    uint64_t values_offset;
+    uint64_t end_offset;
+};
+
+class PhenotypeCache {
+public:
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint32_t kByteOrderMark = 0x01020304;
+
+    // Sidecar path for a phenotype CSV
+    static std::string path_for(const std::string& csv_path);
+
+    // Write the sidecar for csv_path from phenotypes, which must have been
+    // loaded from that CSV with every column. Returns 0 on success, 1 on failure
+    static int write(const Phenotypes& phenotypes, const std::string& csv_path);
+
+    // Load csv_path's sidecar into phenotypes (columns as in
+    // Phenotypes::load). Returns 0 on success, 1 if there is no usable
+    // sidecar, in which case phenotypes is left unchanged
+    static int read(const std::string& csv_path, const std::vector<std::string>& columns,
+                    Phenotypes& phenotypes);
+};
+
+#endif // PHENOTYPE_CACHE_H
@@ -1,6 +1,7 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <limits>
 
 #include <Rcpp.h>
 #define COUT Rcpp::Rcout
@@ -8,31 +9,169 @@
 
 #include "phenotypes.h"
 #include "csv_reader.h"
+#include "number_parse.h"
+#include "phenotype_cache.h"
 
 Phenotypes::Phenotypes() {}
 
 Phenotypes::~Phenotypes() {}
 
-bool Phenotypes::load(const std::string& fname) {
+bool Phenotypes::load(const std::string& fname, const std::vector<std::string>& selected) {
+    if (PhenotypeCache::read(fname, selected, *this) == 0) {
+        return true;
+    }
+    return load_csv(fname, selected);
+}
+
+bool Phenotypes::load_csv(const std::string& fname, const std::vector<std::string>& selected) {
     filename = fname;
+    storage.reset();
     CSVReader reader(filename);
+    headers.clear();
     if (!reader.get_header(headers)) {
         CERR << "Error: Could not read header from " << filename << std::endl;
         return false;
     }
 
-    data.clear();
-    std::vector<std::string> record;
+    // ID column ("id" or "ID", last one wins)
+    int id_col = -1;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (headers[i] == "id" || headers[i] == "ID") {
+            id_col = i;
+        }
+    }
+    has_id_col = (id_col != -1);
+
+    // Columns to materialise, in file order
+    IdDictionary wanted;
+    IdDictionary header_names;
+    for (const auto& name : selected) {
+        wanted.intern(name);
+    }
+    for (const auto& name : headers) {
+        header_names.intern(name);
+    }
+    std::vector<int> trait_cols;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (static_cast<int>(i) == id_col) {
+            continue;
+        }
+        if (selected.empty() || wanted.contains(headers[i])) {
+            trait_cols.push_back(i);
+        }
+    }
+    for (const auto& name : selected) {
+        if (!header_names.contains(name)) {
+            CERR << "Error: Column '" << name << "' not found in " << filename << std::endl;
+            return false;
+        }
+    }
+
+    trait_names.clear();
+    for (int col : trait_cols) {
+        trait_names.push_back(headers[col]);
+    }
+    index_traits();
+    columns.assign(trait_cols.size(), std::vector<double>());
+
+    ids.clear();
+    row_ids.clear();
+    id_rows.clear();
+
+    const double missing = std::numeric_limits<double>::quiet_NaN();
+    std::vector<std::string_view> record;
     while (reader.get_record(record)) {
-        data.push_back(record);
+        size_t row = row_ids.size();
+        int index = IdDictionary::npos;
+        if (id_col != -1 && record.size() > static_cast<size_t>(id_col)) {
+            index = ids.intern(record[id_col]);
+            if (index == static_cast<int>(id_rows.size())) {
+                id_rows.push_back(row);
+            }
+        }
+        row_ids.push_back(index);
+
+        for (size_t t = 0; t < trait_cols.size(); t++) {
+            double value = missing;
+            if (record.size() > static_cast<size_t>(trait_cols[t]) &&
+                parse_number(record[trait_cols[t]], value) != NumberStatus::Ok) {
+                value = missing;
+            }
+            columns[t].push_back(value);
+        }
+    }
+
+    column_data.clear();
+    for (const auto& column : columns) {
+        column_data.push_back(column.data());
     }
     return true;
 }
 
+bool Phenotypes::load_columns(const std::string& name,
+                              const std::vector<std::string_view>& row_id_values,
+                              const std::vector<std::string>& names,
+                              const std::vector<const double*>& column_values,
+                              std::shared_ptr<const void> column_storage) {
+    if (names.size() != column_values.size()) {
+        CERR << "Error: Phenotype columns and names differ in number" << std::endl;
+        return false;
+    }
+
+    filename = name;
+    headers.assign(1, "ID");
+    headers.insert(headers.end(), names.begin(), names.end());
+    trait_names = names;
+    index_traits();
+    columns.clear();
+    column_data = column_values;
+    storage = std::move(column_storage);
+    has_id_col = true;
+
+    ids.clear();
+    row_ids.clear();
+    id_rows.clear();
+    ids.reserve(row_id_values.size());
+    for (size_t row = 0; row < row_id_values.size(); row++) {
+        int index = ids.intern(row_id_values[row]);
+        if (index == static_cast<int>(id_rows.size())) {
+            id_rows.push_back(row);
+        }
+        row_ids.push_back(index);
+    }
+    return true;
+}
+
+void Phenotypes::index_traits() {
+    trait_index.clear();
+    trait_columns.clear();
+    trait_index.reserve(trait_names.size());
+    for (size_t i = 0; i < trait_names.size(); i++) {
+        int index = trait_index.intern(trait_names[i]);
+        if (index == static_cast<int>(trait_columns.size())) {
+            trait_columns.push_back(i);
+        }
+    }
+}
+
+int Phenotypes::find_trait(const std::string& trait_name) const {
+    int index = trait_index.find(trait_name);
+    return index != IdDictionary::npos ? trait_columns[index] : -1;
+}
+
+std::string_view Phenotypes::row_id(size_t row) const {
+    return row_ids[row] != IdDictionary::npos ? ids.name(row_ids[row]) : std::string_view();
+}
+
+int Phenotypes::find_row(std::string_view id) const {
+    int index = ids.find(id);
+    return index != IdDictionary::npos ? id_rows[index] : -1;
+}
+
 void Phenotypes::describe() const {
     // Silent - no output to stdout
 }
 
 bool Phenotypes::has_trait(const std::string& trait_name) const {
-    return std::find(headers.begin(), headers.end(), trait_name) != headers.end();
+    return find_trait(trait_name) != -1;
 }
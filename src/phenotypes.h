@@ -1,27 +1,85 @@
 #ifndef PHENOTYPES_H
 #define PHENOTYPES_H
 
+#include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
 
+#include "id_dictionary.h"
+
+// Phenotype file held column-wise: one contiguous double column per loaded
+// trait, NaN marking missing ("", "NA", ".") or non-numeric cells, plus the
+// subject ID of every row. Columns come from the binary cache next to the
+// CSV when it is up to date (see phenotype_cache.h), from the CSV, or from
+// memory owned by the caller (e.g. R vectors).
 class Phenotypes {
 public:
     Phenotypes();
     ~Phenotypes();
 
-    bool load(const std::string& fname);
+    // Load every non-ID column, or only those named in columns; cells of
+    // the other columns are skipped without being parsed
+    bool load(const std::string& fname, const std::vector<std::string>& columns = {});
+
+    // Same as load, but always parse the CSV, ignoring any cache
+    bool load_csv(const std::string& fname, const std::vector<std::string>& columns = {});
+
+    // Use n_rows-long columns that live elsewhere without copying them;
+    // storage keeps that memory alive for the lifetime of this object.
+    // IDs are interned, so row_ids only has to outlive this call.
+    // name stands in for the filename in messages and notes
+    bool load_columns(const std::string& name,
+                      const std::vector<std::string_view>& row_ids,
+                      const std::vector<std::string>& trait_names,
+                      const std::vector<const double*>& columns,
+                      std::shared_ptr<const void> storage);
+
     void describe() const;
 
     // Instance methods
     bool has_trait(const std::string& trait_name) const;
     const std::string& get_filename() const { return filename; }
+
+    // Every column named in the file header, loaded or not
     const std::vector<std::string>& get_headers() const { return headers; }
-    const std::vector<std::vector<std::string>>& get_data() const { return data; }
+
+    // Loaded trait columns, in file order
+    const std::vector<std::string>& get_trait_names() const { return trait_names; }
+    int find_trait(const std::string& trait_name) const;
+
+    // num_rows() values of a loaded trait
+    const double* get_trait(int index) const { return column_data[index]; }
+
+    size_t num_rows() const { return row_ids.size(); }
+
+    // True if the file has an "id" or "ID" column
+    bool has_ids() const { return has_id_col; }
+
+    // ID of a row (empty if the row has none)
+    std::string_view row_id(size_t row) const;
+
+    // Row of the first record with this ID, -1 if the ID is not present
+    int find_row(std::string_view id) const;
 
 private:
+    friend class PhenotypeCache;
+
+    // Rebuild trait_index from trait_names, so find_trait is a hash lookup
+    void index_traits();
+
     std::string filename;
     std::vector<std::string> headers;
-    std::vector<std::vector<std::string>> data;
+    std::vector<std::string> trait_names;
+    IdDictionary trait_index;        // trait name -> dictionary index
+    std::vector<int> trait_columns;  // dictionary index -> first trait with that name
+    std::vector<std::vector<double>> columns;  // parsed from the CSV, one per trait
+    std::vector<const double*> column_data;    // one per trait, into columns or storage
+    std::shared_ptr<const void> storage;       // cache mapping or caller memory behind column_data
+    bool has_id_col = false;
+    IdDictionary ids;
+    std::vector<int> row_ids;  // row -> dictionary index, IdDictionary::npos if none
+    std::vector<int> id_rows;  // dictionary index -> first row
 };
 
-#endif
\ No newline at end of file
+#endif
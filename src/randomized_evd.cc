@@ -0,0 +1,196 @@
+/*
+ * randomized_evd.cc - Truncated phi2 decomposition by randomized subspace iteration
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+#include "randomized_evd.h"
+#include "evd.h"
+#include "kinship_matrix.h"
+#include "log_sink.h"
+
+// Extra columns carried beyond the rank, and the sweep limit
+static const size_t kOversampling = 10;
+static const size_t kMaxIterations = 30;
+
+// Stop once every kept pair has ||K u - theta u|| below this fraction of
+// the largest eigenvalue (an eigenvalue is then off by about its square);
+// pedigree spectra cluster, so near the cut it may take every sweep
+static const double kResidualTolerance = 1e-6;
+
+// First and last ranks tried in tolerance mode
+static const size_t kInitialRank = 32;
+static const size_t kMaxToleranceRank = 4096;
+
+// Fixed so that a truncated EVD (and its cache key) is reproducible
+static const unsigned long long kSeed = 20240917ULL;
+
+namespace {
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrix;
+
+    // y = K x, through the row-major layout KinshipMatrix::multiply takes
+    void multiply(const KinshipMatrix& phi2, const Eigen::MatrixXd& x, Eigen::MatrixXd& y) {
+        RowMatrix in = x;
+        RowMatrix out(x.rows(), x.cols());
+        phi2.multiply(in.data(), static_cast<size_t>(in.cols()), out.data());
+        y = out;
+    }
+
+    // Orthonormal basis of the columns of w (thin Householder Q)
+    void orthonormalize(const Eigen::MatrixXd& w, Eigen::MatrixXd& q) {
+        Eigen::HouseholderQR<Eigen::MatrixXd> qr(w);
+        q = Eigen::MatrixXd::Identity(w.rows(), w.cols());
+        qr.householderQ().applyThisOnTheLeft(q);
+    }
+
+    // Every eigenpair of phi2, for ranks too close to n to truncate
+    int decompose_exact(const KinshipMatrix& phi2, EigenSolverBackend solver, EvdBlock& block) {
+        size_t n = phi2.size();
+        std::vector<int> rows(n);
+        std::iota(rows.begin(), rows.end(), 0);
+        std::vector<double> dense(n * n);
+        phi2.fill_dense(rows, rows, dense.data());
+        int info = EigenSolver::decompose(solver, static_cast<int>(n), dense, block.values, block.vectors);
+        if (info != 0) {
+            LogSink::error(std::string("Error: ") + EigenSolver::name(EigenSolver::resolve(solver, static_cast<int>(n))) +
+                           " eigenvalue decomposition of a " + std::to_string(n) +
+                           "-subject matrix failed with code " + std::to_string(info));
+            return 1;
+        }
+        return 0;
+    }
+
+    // The rank largest eigenpairs of phi2 (rank + kOversampling < n), values
+    // ascending; report gets the iterations and residual
+    int decompose_leading(const KinshipMatrix& phi2, size_t rank, EigenSolverBackend solver, EvdBlock& block,
+                          RandomizedEvdReport& report) {
+        size_t n = phi2.size();
+        size_t width = rank + kOversampling;
+
+        std::mt19937_64 generator(kSeed);
+        std::normal_distribution<double> normal;
+        Eigen::MatrixXd q(n, width);
+        for (Eigen::Index j = 0; j < q.cols(); j++) {
+            for (Eigen::Index i = 0; i < q.rows(); i++) {
+                q(i, j) = normal(generator);
+            }
+        }
+
+        Eigen::MatrixXd w;
+        multiply(phi2, q, w);
+        orthonormalize(w, q);
+
+        Eigen::MatrixXd u, ku;
+        std::vector<double> values, vectors;
+        report.converged = false;
+        for (report.iterations = 1; report.iterations <= kMaxIterations; report.iterations++) {
+            // Rayleigh-Ritz on span(q): B = Q^T K Q
+            multiply(phi2, q, w);
+            Eigen::MatrixXd b;
+            b.noalias() = q.transpose() * w;
+            b = 0.5 * (b + b.transpose()).eval();
+
+            std::vector<double> b_array(b.data(), b.data() + b.size());
+            int info = EigenSolver::decompose(solver, static_cast<int>(width), b_array, values, vectors);
+            if (info != 0) {
+                LogSink::error(std::string("Error: ") + EigenSolver::name(EigenSolver::resolve(solver, static_cast<int>(width))) +
+                               " eigenvalue decomposition of a " + std::to_string(width) +
+                               "-column Rayleigh quotient failed with code " + std::to_string(info));
+                return 1;
+            }
+
+            // Leading Ritz pairs are the last rank columns (values ascending)
+            Eigen::Map<const Eigen::MatrixXd> s(vectors.data(), width, width);
+            u.noalias() = q * s.rightCols(rank);
+            ku.noalias() = w * s.rightCols(rank);
+
+            double largest = std::max(std::fabs(values.front()), std::fabs(values.back()));
+            report.max_residual = 0.0;
+            for (size_t j = 0; j < rank; j++) {
+                double theta = values[width - rank + j];
+                double residual = (ku.col(j) - theta * u.col(j)).norm();
+                report.max_residual = std::max(report.max_residual, residual);
+            }
+            if (largest > 0.0) {
+                report.max_residual /= largest;
+            }
+            if (report.max_residual <= kResidualTolerance) {
+                report.converged = true;
+                break;
+            }
+            if (report.iterations == kMaxIterations) {
+                break;
+            }
+            orthonormalize(w, q);
+        }
+
+        block.values.assign(values.end() - rank, values.end());
+        block.vectors.assign(u.data(), u.data() + u.size());
+        return 0;
+    }
+}
+
+int RandomizedEvd::decompose(const KinshipMatrix& phi2, size_t rank, double tolerance, EigenSolverBackend solver,
+                             Evd& evd, RandomizedEvdReport& report) {
+    size_t n = phi2.size();
+    if (n == 0) {
+        LogSink::error("Error: No subjects to decompose");
+        return 1;
+    }
+
+    double trace = phi2.trace();
+    double squared_norm = phi2.squared_norm();
+
+    evd.blocks.assign(1, EvdBlock());
+    EvdBlock& block = evd.blocks[0];
+    block.rows.resize(n);
+    std::iota(block.rows.begin(), block.rows.end(), 0);
+
+    size_t k = rank > 0 ? rank : std::min(kInitialRank, n);
+    while (true) {
+        report = RandomizedEvdReport();
+        if (k + kOversampling >= n) {
+            if (decompose_exact(phi2, solver, block) != 0) {
+                return 1;
+            }
+            report.rank = n;
+            break;
+        }
+
+        if (decompose_leading(phi2, k, solver, block, report) != 0) {
+            return 1;
+        }
+        report.rank = k;
+
+        // The remaining eigenvalues sum to trace - sum(theta) and their
+        // squares to ||K||_F^2 - sum(theta^2)
+        double sum = 0.0, sum_squares = 0.0;
+        for (double theta : block.values) {
+            sum += theta;
+            sum_squares += theta * theta;
+        }
+        double remaining = static_cast<double>(n - k);
+        report.remainder_mean = std::max((trace - sum) / remaining, 0.0);
+        double mean_square = (squared_norm - sum_squares) / remaining;
+        report.remainder_spread =
+            std::sqrt(std::max(mean_square - report.remainder_mean * report.remainder_mean, 0.0));
+
+        if (rank > 0) {
+            break;
+        }
+        report.tolerance_met = report.remainder_spread <= tolerance * report.remainder_mean;
+        if (report.tolerance_met || 2 * k > kMaxToleranceRank) {
+            break;
+        }
+        k *= 2;
+    }
+
+    evd.remainder_value = report.remainder_mean;
+    return 0;
+}
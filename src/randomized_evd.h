@@ -0,0 +1,47 @@
+/*
+ * randomized_evd.h - Truncated phi2 decomposition by randomized subspace iteration
+ *
+ * For cohorts too large for a dense O(n^3) EVD, only the k largest
+ * eigenpairs of phi2 are computed: a Gaussian block of k + 10 columns is
+ * multiplied by the sparse matrix and re-orthonormalized until the
+ * Rayleigh-Ritz pairs of the block settle, at O(nnz (k + 10)) per sweep and
+ * O(n (k + 10)^2) for the QR. The other n - k eigenvalues are replaced by
+ * their mean, known exactly from the trace, and fitted as one group
+ * (Evd::remainder_value). How far they scatter about that mean follows
+ * from ||phi2||_F^2 and is reported with the Ritz residuals, as the error
+ * of the approximation.
+ */
+
+#ifndef RANDOMIZED_EVD_H
+#define RANDOMIZED_EVD_H
+
+#include <cstddef>
+
+#include "eigen_solver.h"
+
+class Evd;
+class KinshipMatrix;
+
+struct RandomizedEvdReport {
+    size_t rank = 0;                // Components kept
+    size_t iterations = 0;          // Subspace sweeps for the final rank (0 if exact)
+    double max_residual = 0.0;      // max ||K u - theta u|| over kept pairs, relative to the largest theta
+    double remainder_mean = 0.0;    // Mean of the other eigenvalues (the remainder value)
+    double remainder_spread = 0.0;  // Their RMS deviation from that mean
+    bool converged = true;          // Residuals reached the iteration tolerance
+    bool tolerance_met = true;      // Spread within the requested tolerance (tolerance mode)
+};
+
+class RandomizedEvd {
+public:
+    // Leading eigenpairs of phi2 as a single dense block of evd (ids are
+    // left to the caller): rank components, or with rank 0, doubling from
+    // 32 until the remainder spread is at most tolerance times its mean
+    // (giving up past 4096 components, with report.tolerance_met false).
+    // A rank within the oversampling of phi2.size() decomposes exactly.
+    // Returns 0 on success, 1 on failure
+    static int decompose(const KinshipMatrix& phi2, size_t rank, double tolerance, EigenSolverBackend solver,
+                         Evd& evd, RandomizedEvdReport& report);
+};
+
+#endif // RANDOMIZED_EVD_H
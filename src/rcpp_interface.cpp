@@ -1,6 +1,19 @@
 #include <Rcpp.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <limits>
 #include <memory>
 #include "solar_session.h"
+#include "pedigree_loader.h"
+#include "phenotypes.h"
+#include "number_parse.h"
+#include "evd.h"
+#include "evd_file.h"
+#include "evd_altrep.h"
+#include "build_info.h"
+#include "eigen_solver.h"
+#include "parallel_for.h"
 
 using namespace Rcpp;
 
@@ -13,6 +26,168 @@ namespace {
         }
         return *g_default_session;
     }
+
+    // Session behind a handle from solar_session(), or the global session
+    // for NULL
+    SolarSession& get_session(SEXP session) {
+        if (Rf_isNull(session)) {
+            return get_default_session();
+        }
+        if (TYPEOF(session) != EXTPTRSXP || !Rf_inherits(session, "solar_session")) {
+            stop("session must be created by solar_session()");
+        }
+        SolarSession* state = static_cast<SolarSession*>(R_ExternalPtrAddr(session));
+        if (!state) {
+            stop("Session is no longer valid (sessions are not kept by save() or saveRDS())");
+        }
+        return *state;
+    }
+
+    // R vectors whose memory is used in place, plus columns that had to
+    // be converted to double. Vectors used in place are marked not
+    // mutable, so an assignment in R copies them instead of changing the
+    // loaded phenotypes
+    struct RColumns {
+        RObject object;
+        std::vector<std::vector<double>> converted;
+    };
+
+    // Subject IDs of an R vector. Character vectors are viewed in place;
+    // factors, integers and doubles are formatted as write.csv would
+    struct IdColumn {
+        std::vector<std::string> formatted;
+        std::vector<std::string_view> views;
+    };
+
+    void read_id_column(SEXP column, IdColumn& ids) {
+        R_xlen_t n = Rf_xlength(column);
+        ids.formatted.clear();
+        ids.views.clear();
+        ids.views.reserve(n);
+
+        if (TYPEOF(column) == STRSXP) {
+            for (R_xlen_t i = 0; i < n; i++) {
+                ids.views.emplace_back(CHAR(STRING_ELT(column, i)));
+            }
+            return;
+        }
+
+        ids.formatted.reserve(n);
+        if (Rf_isFactor(column)) {
+            SEXP levels = Rf_getAttrib(column, R_LevelsSymbol);
+            const int* codes = INTEGER(column);
+            for (R_xlen_t i = 0; i < n; i++) {
+                ids.formatted.emplace_back(codes[i] == NA_INTEGER ? "NA" : CHAR(STRING_ELT(levels, codes[i] - 1)));
+            }
+        } else if (TYPEOF(column) == INTSXP) {
+            const int* values = INTEGER(column);
+            for (R_xlen_t i = 0; i < n; i++) {
+                ids.formatted.push_back(values[i] == NA_INTEGER ? "NA" : std::to_string(values[i]));
+            }
+        } else if (TYPEOF(column) == REALSXP) {
+            const double* values = REAL(column);
+            char buffer[32];
+            for (R_xlen_t i = 0; i < n; i++) {
+                if (ISNAN(values[i])) {
+                    ids.formatted.emplace_back("NA");
+                } else {
+                    std::snprintf(buffer, sizeof(buffer), "%.15g", values[i]);
+                    ids.formatted.emplace_back(buffer);
+                }
+            }
+        } else {
+            stop("ID columns must be character, factor or numeric");
+        }
+        for (const auto& id : ids.formatted) {
+            ids.views.emplace_back(id);
+        }
+    }
+
+    // Values of an R vector as doubles (NaN for NA). Double vectors are
+    // used in place; anything else is converted into storage.converted
+    const double* numeric_column(SEXP column, RColumns& storage) {
+        if (TYPEOF(column) == REALSXP && !Rf_isFactor(column)) {
+            MARK_NOT_MUTABLE(column);
+            return REAL(column);
+        }
+
+        R_xlen_t n = Rf_xlength(column);
+        const double missing = std::numeric_limits<double>::quiet_NaN();
+        std::vector<double> values(n, missing);
+        if (Rf_isFactor(column)) {
+            SEXP levels = Rf_getAttrib(column, R_LevelsSymbol);
+            const int* codes = INTEGER(column);
+            for (R_xlen_t i = 0; i < n; i++) {
+                if (codes[i] != NA_INTEGER && parse_number(CHAR(STRING_ELT(levels, codes[i] - 1)), values[i]) != NumberStatus::Ok) {
+                    values[i] = missing;
+                }
+            }
+        } else if (TYPEOF(column) == INTSXP || TYPEOF(column) == LGLSXP) {
+            const int* source = TYPEOF(column) == INTSXP ? INTEGER(column) : LOGICAL(column);
+            for (R_xlen_t i = 0; i < n; i++) {
+                if (source[i] != NA_INTEGER) {
+                    values[i] = source[i];
+                }
+            }
+        } else if (TYPEOF(column) == STRSXP) {
+            for (R_xlen_t i = 0; i < n; i++) {
+                SEXP value = STRING_ELT(column, i);
+                if (value != NA_STRING && parse_number(CHAR(value), values[i]) != NumberStatus::Ok) {
+                    values[i] = missing;
+                }
+            }
+        }
+        storage.converted.push_back(std::move(values));
+        return storage.converted.back().data();
+    }
+
+    bool is_numeric_matrix(SEXP x) {
+        return Rf_isMatrix(x) && (TYPEOF(x) == REALSXP || TYPEOF(x) == INTSXP);
+    }
+
+    // ids, values, an ALTREP view of the eigenvectors and the remainder
+    // of a low-rank EVD
+    List evd_list(std::shared_ptr<const Evd> evd) {
+        std::vector<double> eigenvalues = evd->eigenvalues();
+        CharacterVector ids = wrap(evd->ids);
+        NumericVector values(eigenvalues.begin(), eigenvalues.end());
+        double remainder_value = evd->remainder_value;
+        double remainder_components = static_cast<double>(evd->num_remainder());
+        return List::create(
+            _["ids"] = ids,
+            _["values"] = values,
+            _["vectors"] = make_evd_vectors_view(std::move(evd)),
+            _["remainder_value"] = remainder_value,
+            _["remainder_components"] = remainder_components);
+    }
+}
+
+//' Create an analysis session
+//'
+//' Every solar_* function works on a session: the global one by default,
+//' or the one passed as its session argument. Sessions keep separate
+//' pedigrees, phenotypes, traits and settings, so several cohorts can be
+//' loaded at once. A session is freed when its handle is garbage
+//' collected.
+//'
+//' A session created with share uses that session's pedigree without
+//' reloading it. Decompositions of the same subjects are then computed
+//' once and used by both sessions while either still holds them.
+//'
+//' @param share Session whose loaded pedigree the new session uses
+//'   (default: NULL, start empty)
+//' @return A session handle of class "solar_session"
+//' @export
+// [[Rcpp::export]]
+SEXP solar_session(SEXP share = R_NilValue) {
+    XPtr<SolarSession> handle(new SolarSession(), true);
+    if (!Rf_isNull(share)) {
+        if (handle->share_pedigree(get_session(share)) != 0) {
+            stop("Cannot share pedigree");
+        }
+    }
+    handle.attr("class") = "solar_session";
+    return handle;
 }
 
 //' Load pedigree file
@@ -22,23 +197,288 @@ namespace {
 //' @param pedigree_filename Path to the pedigree CSV file
 //' @param threshold Kinship threshold (0.0 for theoretical pedigrees, >0 for empirical)
 //' @param output_dir Directory where pedigree output files will be created
+//' @param session Session from solar_session() (default: the global session)
 //' @return Returns 0 on success, 1 on failure
 //' @export
 // [[Rcpp::export]]
-int solar_load_pedigree(std::string pedigree_filename, double threshold = 0.0, std::string output_dir = "") {
-    return get_default_session().load_pedigree(pedigree_filename, threshold, output_dir);
+int solar_load_pedigree(std::string pedigree_filename, double threshold = 0.0, std::string output_dir = "",
+                        SEXP session = R_NilValue) {
+    return get_session(session).load_pedigree(pedigree_filename, threshold, output_dir);
 }
 
 //' Load phenotype file
 //'
 //' Load a phenotype file for analysis. Pedigree must be loaded first.
 //'
+//' Values are stored as one numeric column per trait; empty, "NA", "." and
+//' non-numeric cells are treated as missing.
+//'
+//' @param phenotype_filename Path to the phenotype CSV file
+//' @param columns Character vector of trait columns to load (default: all
+//'   non-ID columns). Other columns are skipped without being parsed.
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success, 1 on failure
+//' @export
+// [[Rcpp::export]]
+int solar_load_phenotype(std::string phenotype_filename,
+                         Rcpp::CharacterVector columns = Rcpp::CharacterVector::create(),
+                         SEXP session = R_NilValue) {
+    return get_session(session).load_phenotypes(phenotype_filename, Rcpp::as<std::vector<std::string>>(columns));
+}
+
+//' Cache phenotype file
+//'
+//' Convert a phenotype CSV once to a column-major binary file
+//' (<phenotype_filename>.solarphen). solar_load_phenotype() then reads the
+//' cache instead of the CSV for as long as the CSV is unchanged, and loading
+//' a few traits of a very wide file only reads those columns.
+//'
+//' The CSV counts as unchanged while its size, its modification time and a
+//' checksum of its header line and its first and last 64 KiB match the
+//' cache. Only the size and modification time guard the middle of the
+//' file, so after editing it in a way that keeps both (e.g. restoring the
+//' modification time), run solar_cache_phenotype() again.
+//'
 //' @param phenotype_filename Path to the phenotype CSV file
 //' @return Returns 0 on success, 1 on failure
 //' @export
 // [[Rcpp::export]]
-int solar_load_phenotype(std::string phenotype_filename) {
-    return get_default_session().load_phenotypes(phenotype_filename);
+int solar_cache_phenotype(std::string phenotype_filename) {
+    return get_default_session().cache_phenotypes(phenotype_filename);
+}
+
+//' Load pedigree from R data
+//'
+//' Load a pedigree from an R object instead of a CSV file, with the same
+//' threshold and output files as solar_load_pedigree().
+//'
+//' @param pedigree Either a data.frame of kinship rows with IDA, IDB and KIN
+//'   columns (matched as in the CSV header), or a square numeric kinship
+//'   matrix with subject IDs as row or column names
+//' @param threshold Kinship threshold (0.0 for theoretical pedigrees, >0 for empirical)
+//' @param output_dir Directory where pedigree output files will be created
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success, 1 on failure
+//' @export
+// [[Rcpp::export]]
+int solar_load_pedigree_data(SEXP pedigree, double threshold = 0.0, std::string output_dir = "",
+                             SEXP session = R_NilValue) {
+    KinshipTable table;
+    IdColumn ida;
+    IdColumn idb;
+    std::vector<double> kin;
+    RColumns storage;
+
+    if (is_numeric_matrix(pedigree)) {
+        // Upper triangle of the kinship matrix; zeros never pass the threshold
+        NumericMatrix matrix(pedigree);
+        int n = matrix.nrow();
+        if (matrix.ncol() != n) {
+            stop("Kinship matrix must be square");
+        }
+        SEXP dimnames = Rf_getAttrib(matrix, R_DimNamesSymbol);
+        SEXP names = R_NilValue;
+        if (!Rf_isNull(dimnames)) {
+            names = Rf_isNull(VECTOR_ELT(dimnames, 0)) ? VECTOR_ELT(dimnames, 1) : VECTOR_ELT(dimnames, 0);
+        }
+        if (Rf_isNull(names)) {
+            stop("Kinship matrix needs subject IDs as row or column names");
+        }
+        read_id_column(names, ida);
+        for (int i = 0; i < n; i++) {
+            for (int j = i; j < n; j++) {
+                double value = matrix(i, j);
+                if (i == j || value != 0.0) {
+                    table.ida.push_back(ida.views[i]);
+                    table.idb.push_back(ida.views[j]);
+                    kin.push_back(value);
+                }
+            }
+        }
+        table.kin = kin.data();
+    } else if (Rf_inherits(pedigree, "data.frame")) {
+        List frame(pedigree);
+        CharacterVector names = frame.names();
+        int ida_col = -1, idb_col = -1, kin_col = -1;
+        for (int i = 0; i < names.size(); i++) {
+            std::string lower = as<std::string>(names[i]);
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            if (lower.find("id") == 0) {
+                if (ida_col == -1) {
+                    ida_col = i;
+                } else if (idb_col == -1) {
+                    idb_col = i;
+                }
+            } else if (lower == "kin") {
+                kin_col = i;
+            }
+        }
+        if (ida_col == -1 || idb_col == -1 || kin_col == -1) {
+            stop("Missing required columns IDA, IDB, or KIN");
+        }
+        read_id_column(frame[ida_col], ida);
+        read_id_column(frame[idb_col], idb);
+        table.ida = std::move(ida.views);
+        table.idb = std::move(idb.views);
+        table.kin = numeric_column(frame[kin_col], storage);
+    } else {
+        stop("pedigree must be a data.frame or a numeric matrix");
+    }
+
+    return get_session(session).load_pedigree(table, threshold, output_dir);
+}
+
+//' Load phenotypes from R data
+//'
+//' Load phenotypes from an R object instead of a CSV file. Double columns
+//' are used in place without copying; other column types are converted.
+//' Pedigree must be loaded first.
+//'
+//' @param phenotypes Either a data.frame with an "id" or "ID" column and one
+//'   column per trait, or a numeric matrix with subject IDs as row names and
+//'   traits as column names
+//' @param columns Character vector of trait columns to load (default: all
+//'   non-ID columns)
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success, 1 on failure
+//' @export
+// [[Rcpp::export]]
+int solar_load_phenotype_data(SEXP phenotypes,
+                              Rcpp::CharacterVector columns = Rcpp::CharacterVector::create(),
+                              SEXP session = R_NilValue) {
+    std::vector<std::string> selected = as<std::vector<std::string>>(columns);
+    auto storage = std::make_shared<RColumns>();
+    storage->object = phenotypes;
+
+    IdColumn ids;
+    std::vector<std::string> trait_names;
+    std::vector<const double*> trait_columns;
+    std::string name;
+
+    IdDictionary selected_names;
+    for (const auto& trait : selected) {
+        selected_names.intern(trait);
+    }
+    auto wanted = [&](const std::string& trait) {
+        return selected.empty() || selected_names.contains(trait);
+    };
+
+    if (is_numeric_matrix(phenotypes)) {
+        SEXP matrix = phenotypes;
+        if (TYPEOF(matrix) != REALSXP) {
+            matrix = Rf_coerceVector(matrix, REALSXP);
+            storage->object = matrix;
+        }
+        MARK_NOT_MUTABLE(matrix);
+        int n_rows = Rf_nrows(matrix);
+        int n_cols = Rf_ncols(matrix);
+        SEXP dimnames = Rf_getAttrib(matrix, R_DimNamesSymbol);
+        if (Rf_isNull(dimnames) || Rf_isNull(VECTOR_ELT(dimnames, 0)) || Rf_isNull(VECTOR_ELT(dimnames, 1))) {
+            stop("Phenotype matrix needs subject IDs as row names and traits as column names");
+        }
+        read_id_column(VECTOR_ELT(dimnames, 0), ids);
+        SEXP col_names = VECTOR_ELT(dimnames, 1);
+        for (int c = 0; c < n_cols; c++) {
+            std::string trait = CHAR(STRING_ELT(col_names, c));
+            if (wanted(trait)) {
+                trait_names.push_back(trait);
+                trait_columns.push_back(REAL(matrix) + static_cast<R_xlen_t>(c) * n_rows);
+            }
+        }
+        name = "<matrix>";
+    } else if (Rf_inherits(phenotypes, "data.frame")) {
+        List frame(phenotypes);
+        CharacterVector names = frame.names();
+        int id_col = -1;
+        for (int i = 0; i < names.size(); i++) {
+            if (names[i] == "id" || names[i] == "ID") {
+                id_col = i;
+            }
+        }
+        if (id_col == -1) {
+            stop("Phenotype data.frame needs an 'id' or 'ID' column");
+        }
+        read_id_column(frame[id_col], ids);
+        for (int i = 0; i < names.size(); i++) {
+            std::string trait = as<std::string>(names[i]);
+            if (i != id_col && wanted(trait)) {
+                trait_names.push_back(trait);
+                trait_columns.push_back(numeric_column(frame[i], *storage));
+            }
+        }
+        name = "<data.frame>";
+    } else {
+        stop("phenotypes must be a data.frame or a numeric matrix");
+    }
+
+    IdDictionary found_names;
+    for (const auto& trait : trait_names) {
+        found_names.intern(trait);
+    }
+    for (const auto& trait : selected) {
+        if (!found_names.contains(trait)) {
+            Rcerr << "Error: Column '" << trait << "' not found in phenotype data" << std::endl;
+            return 1;
+        }
+    }
+
+    auto loaded = std::make_unique<Phenotypes>();
+    if (!loaded->load_columns(name, ids.views, trait_names, trait_columns, storage)) {
+        return 1;
+    }
+    return get_session(session).load_phenotypes(std::move(loaded));
+}
+
+//' Use genotypes as the kinship
+//'
+//' Replace the pedigree's phi2 by the genetic relationship matrix
+//' GRM = Z Z^T / m of m markers, where Z holds the allele counts of each
+//' marker centered by twice its allele frequency and scaled by
+//' sqrt(2p(1 - p)) (missing calls are set to the mean, and monomorphic
+//' markers dropped). Only Z is kept: the eigendecomposition for a set of
+//' subjects comes from a thin SVD of their rows, costing O(n m^2) instead
+//' of O(n^3) when there are fewer markers than subjects. The EVD then has
+//' at most m components; the GRM's other eigenvalues are exactly 0 and
+//' enter the fit as one group rather than as n - m separate components.
+//'
+//' The pedigree must be loaded first. Subjects without genotypes are left
+//' out of the fit. Pass NULL to go back to the pedigree's phi2.
+//'
+//' @param genotypes Path prefix of a PLINK binary fileset (<prefix>.bed,
+//'   .bim and .fam; subjects are the .fam IIDs), a numeric matrix of allele
+//'   counts (0, 1, 2 or NA) with subject IDs as row names and one column
+//'   per marker, or NULL
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success, 1 on failure
+//' @export
+// [[Rcpp::export]]
+int solar_load_genotypes(SEXP genotypes, SEXP session = R_NilValue) {
+    SolarSession& state = get_session(session);
+    if (Rf_isNull(genotypes)) {
+        state.clear_genotypes();
+        return 0;
+    }
+
+    if (TYPEOF(genotypes) == STRSXP && Rf_xlength(genotypes) == 1) {
+        std::string prefix = CHAR(STRING_ELT(genotypes, 0));
+        if (prefix.size() > 4 && prefix.compare(prefix.size() - 4, 4, ".bed") == 0) {
+            prefix.resize(prefix.size() - 4);
+        }
+        return state.load_genotypes(prefix);
+    }
+
+    if (!is_numeric_matrix(genotypes)) {
+        stop("genotypes must be a PLINK path prefix, a numeric matrix or NULL");
+    }
+    NumericMatrix counts(genotypes);  // Copies integer matrices to double
+    SEXP dimnames = Rf_getAttrib(counts, R_DimNamesSymbol);
+    if (Rf_isNull(dimnames) || Rf_isNull(VECTOR_ELT(dimnames, 0))) {
+        stop("Genotype matrix needs subject IDs as row names");
+    }
+    IdColumn ids;
+    read_id_column(VECTOR_ELT(dimnames, 0), ids);
+    std::vector<std::string> id_strings(ids.views.begin(), ids.views.end());
+    return state.load_genotypes(id_strings, counts.begin(), counts.ncol());
 }
 
 //' Select trait for analysis
@@ -46,11 +486,12 @@ int solar_load_phenotype(std::string phenotype_filename) {
 //' Select a trait from the loaded phenotype file. Phenotypes must be loaded first.
 //'
 //' @param trait_name Name of the trait column in the phenotype file
+//' @param session Session from solar_session() (default: the global session)
 //' @return Returns 0 on success, 1 on failure
 //' @export
 // [[Rcpp::export]]
-int solar_select_trait(std::string trait_name) {
-    return get_default_session().select_trait(trait_name);
+int solar_select_trait(std::string trait_name, SEXP session = R_NilValue) {
+    return get_session(session).select_trait(trait_name);
 }
 
 //' Run FPHI analysis
@@ -60,18 +501,400 @@ int solar_select_trait(std::string trait_name) {
 //'
 //' Creates output files:
 //'   - <output_basename>.ids
-//'   - <output_basename>.eigenvalues
-//'   - <output_basename>.eigenvectors
+//'   - <output_basename>.evd (binary eigendecomposition)
 //'   - <output_basename>.notes
 //'   - <output_basename>_fphi_results.out
 //'   - <output_basename>_parameters.out
 //'
 //' @param output_basename Base name for output files (default: "fphi_output")
+//' @param session Session from solar_session() (default: the global session)
 //' @return Returns 0 on success, 1 on failure
 //' @export
 // [[Rcpp::export]]
-int solar_run_fphi(std::string output_basename = "fphi_output") {
-    return get_default_session().run_fphi(output_basename);
+int solar_run_fphi(std::string output_basename = "fphi_output", SEXP session = R_NilValue) {
+    return get_session(session).run_fphi(output_basename);
+}
+
+//' Run FPHI analysis for a batch of traits
+//'
+//' Run FPHI heritability analysis for many traits, each on every subject
+//' with a value for it. Traits missing the same subjects share one
+//' eigendecomposition, so the batch needs one EVD per missingness pattern
+//' (computed in parallel) rather than one per trait. Each pattern's traits
+//' are projected with one matrix multiply per block, and the per-trait fits
+//' run in parallel. Pedigree and phenotypes must be loaded first.
+//'
+//' Creates output files (with several missingness patterns the .ids, .evd
+//' and .notes files are written once per pattern, as
+//' <output_basename>_pattern1.evd and so on):
+//'   - <output_basename>.ids
+//'   - <output_basename>.evd (binary eigendecomposition)
+//'   - <output_basename>.notes
+//'   - <output_basename>_fphi_results.out (one row per trait)
+//'   - <output_basename>_parameters.out (one row per trait and parameter)
+//'
+//' @param traits Character vector of trait columns (default: all non-ID columns)
+//' @param output_basename Base name for output files (default: "fphi_batch")
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success, 1 on failure
+//' @export
+// [[Rcpp::export]]
+int solar_run_fphi_batch(Rcpp::CharacterVector traits = Rcpp::CharacterVector::create(),
+                         std::string output_basename = "fphi_batch", SEXP session = R_NilValue) {
+    return get_session(session).run_fphi_batch(Rcpp::as<std::vector<std::string>>(traits), output_basename);
+}
+
+//' Run FPHI analysis and return the estimates
+//'
+//' Fit FPHI to one or more traits, as solar_run_fphi_batch() does, and
+//' return the estimates as a data.frame. Files are written only when an
+//' output basename is given, so repeated fits leave nothing on disk.
+//' The eigendecomposition of the first trait's subjects is available
+//' afterwards from solar_get_evd().
+//'
+//' @param traits Character vector of trait columns (default: all loaded traits)
+//' @param output_basename Base name for output files as in
+//'   solar_run_fphi_batch() (default: "", write no files)
+//' @param session Session from solar_session() (default: the global session)
+//' @return A data.frame with one row per trait and columns trait, h2r,
+//'   h2r_se, loglik, sporadic_loglik, p_value, n_subjects, mean, mean_se,
+//'   e2, e2_se, sd and sd_se, or NULL on failure
+//' @export
+// [[Rcpp::export]]
+SEXP solar_fphi(Rcpp::CharacterVector traits = Rcpp::CharacterVector::create(),
+                std::string output_basename = "", SEXP session = R_NilValue) {
+    std::vector<FphiResult> results;
+    if (get_session(session).fit_fphi(as<std::vector<std::string>>(traits), output_basename, results) != 0) {
+        return R_NilValue;
+    }
+
+    size_t n = results.size();
+    CharacterVector trait(n);
+    NumericVector h2r(n), h2r_se(n), loglik(n), sporadic_loglik(n), p_value(n);
+    IntegerVector n_subjects(n);
+    NumericVector mean(n), mean_se(n), e2(n), e2_se(n), sd(n), sd_se(n);
+    for (size_t i = 0; i < n; i++) {
+        const FphiResult& r = results[i];
+        trait[i] = r.trait;
+        h2r[i] = r.h2r;
+        h2r_se[i] = r.h2r_se;
+        loglik[i] = r.loglik;
+        sporadic_loglik[i] = r.sporadic_loglik;
+        p_value[i] = r.pvalue;
+        n_subjects[i] = static_cast<int>(r.n_subjects);
+        mean[i] = r.mean;
+        mean_se[i] = r.mean_se;
+        e2[i] = r.e2;
+        e2_se[i] = r.e2_se;
+        sd[i] = r.sd;
+        sd_se[i] = r.sd_se;
+    }
+
+    List columns = List::create(
+        _["trait"] = trait, _["h2r"] = h2r, _["h2r_se"] = h2r_se,
+        _["loglik"] = loglik, _["sporadic_loglik"] = sporadic_loglik,
+        _["p_value"] = p_value, _["n_subjects"] = n_subjects,
+        _["mean"] = mean, _["mean_se"] = mean_se, _["e2"] = e2, _["e2_se"] = e2_se,
+        _["sd"] = sd, _["sd_se"] = sd_se);
+    columns.attr("row.names") = IntegerVector::create(NA_INTEGER, -static_cast<int>(n));
+    columns.attr("class") = "data.frame";
+    return columns;
+}
+
+//' Get the eigendecomposition of the last FPHI run
+//'
+//' Return the eigendecomposition of the kinship matrix used by the most
+//' recent solar_run_fphi(), solar_run_fphi_batch() or solar_fphi() call.
+//'
+//' The eigenvectors are not copied: vectors is an ALTREP matrix reading
+//' the session's buffer, which stays valid after later runs or
+//' solar_reset(). Block-diagonal decompositions read as a dense matrix
+//' with zeros outside each family's block, and are only expanded in
+//' memory if R needs the whole matrix at once (e.g. for \code{\%*\%}).
+//'
+//' @param session Session from solar_session() (default: the global session)
+//' @return A list with ids (subject IDs in row order), values (eigenvalues),
+//'   vectors (a subjects x components matrix of eigenvectors), and
+//'   remainder_value and remainder_components (the eigenvalue and number
+//'   of the components a low-rank EVD from genotypes does not store; 0
+//'   components otherwise), or NULL if no analysis has been run
+//' @export
+// [[Rcpp::export]]
+SEXP solar_get_evd(SEXP session = R_NilValue) {
+    std::shared_ptr<const Evd> evd = get_session(session).share_evd();
+    if (!evd) {
+        return R_NilValue;
+    }
+    return evd_list(std::move(evd));
+}
+
+//' Read an EVD file
+//'
+//' Map a binary .evd file written by an FPHI run with EVD output enabled
+//' (see solar_set_write_evd()). The eigenvectors are exposed as an ALTREP
+//' matrix pointing into the mapping, so only the pages R reads are loaded.
+//'
+//' @param path Path to the .evd file
+//' @param verify Check the file's checksum, which reads it once in full
+//'   (default: TRUE)
+//' @return A list as returned by solar_get_evd(), or NULL on failure
+//' @export
+// [[Rcpp::export]]
+SEXP solar_read_evd(std::string path, bool verify = true) {
+    auto evd = std::make_shared<Evd>();
+    if (EvdFile::read(path, *evd, verify) != 0) {
+        return R_NilValue;
+    }
+    return evd_list(std::move(evd));
+}
+
+//' Project traits onto the eigenvectors
+//'
+//' Compute U^T * Y for the eigenvectors U of the last FPHI run and the
+//' trait columns Y in subject order, without expanding U in R. Every
+//' subject of the decomposition must have a value for each trait.
+//'
+//' @param traits Character vector of trait columns (default: all loaded traits)
+//' @param session Session from solar_session() (default: the global session)
+//' @return A components x traits matrix with traits as column names, or
+//'   NULL on failure
+//' @export
+// [[Rcpp::export]]
+SEXP solar_project_traits(Rcpp::CharacterVector traits = Rcpp::CharacterVector::create(),
+                          SEXP session = R_NilValue) {
+    SolarSession& state = get_session(session);
+    std::vector<std::string> names = as<std::vector<std::string>>(traits);
+    if (names.empty() && state.get_phenotypes()) {
+        names = state.get_phenotypes()->get_trait_names();
+    }
+
+    Eigen::MatrixXd projected;
+    if (state.project_traits(names, projected) != 0) {
+        return R_NilValue;
+    }
+
+    NumericMatrix result(static_cast<int>(projected.rows()), static_cast<int>(projected.cols()));
+    std::copy(projected.data(), projected.data() + projected.size(), result.begin());
+    Rf_setAttrib(result, R_DimNamesSymbol, List::create(R_NilValue, wrap(names)));
+    return result;
+}
+
+//' Use block-diagonal EVD
+//'
+//' Decompose the kinship matrix one family at a time instead of as a single
+//' dense matrix. Families are the connected components found when the
+//' pedigree was loaded, so the result is exact, but the cost drops from
+//' O(n^3) to the sum of O(n_f^3) over families and the eigenvectors are
+//' stored block-sparse in the <output_basename>.evd file.
+//'
+//' @param enabled TRUE for block-diagonal EVD, FALSE for a single dense EVD
+//' @param session Session from solar_session() (default: the global session)
+//' @export
+// [[Rcpp::export]]
+void solar_set_block_evd(bool enabled = true, SEXP session = R_NilValue) {
+    get_session(session).set_block_evd(enabled);
+}
+
+//' Write EVD files
+//'
+//' Control whether FPHI runs write the eigendecomposition to disk
+//' (<output_basename>.ids, .evd and .notes). The decomposition is always
+//' kept in memory and passed directly to the fit, so disabling this skips
+//' the file output entirely; results files are still written.
+//'
+//' @param enabled TRUE to write EVD files (the default), FALSE to skip them
+//' @param session Session from solar_session() (default: the global session)
+//' @export
+// [[Rcpp::export]]
+void solar_set_write_evd(bool enabled = true, SEXP session = R_NilValue) {
+    get_session(session).set_write_evd_files(enabled);
+}
+
+//' Select eigensolver
+//'
+//' Select the eigensolver used to decompose the kinship matrix.
+//' "auto" (the default) uses LAPACK dsyevd, a divide-and-conquer solver that
+//' runs on R's BLAS and so uses every core when R is linked against a
+//' threaded BLAS (OpenBLAS, MKL, Accelerate). From 32767 subjects its
+//' workspace exceeds LAPACK's integer range, so "auto" uses dsyevr there
+//' and an explicit "dsyevd" fails. "dsyevr" is LAPACK's MRRR solver,
+//' "eigen" the bundled Eigen SelfAdjointEigenSolver and "eispack" the
+//' serial TRED2/TQL2 routine of the original SOLAR.
+//'
+//' @param solver One of "auto", "eispack", "eigen", "dsyevd" or "dsyevr"
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success, 1 on failure
+//' @export
+// [[Rcpp::export]]
+int solar_set_eigen_solver(std::string solver = "auto", SEXP session = R_NilValue) {
+    return get_session(session).set_eigen_solver(solver);
+}
+
+//' Set the number of threads
+//'
+//' Set how many threads a session uses for parsing kinship rows,
+//' decomposing family blocks and fitting traits. The session keeps one pool
+//' of worker threads for all of this work; messages from the workers are
+//' printed on the R thread once each parallel step finishes.
+//'
+//' The eigensolvers' BLAS calls use R's BLAS threading, which this setting
+//' does not change.
+//'
+//' @param threads Number of threads (default: 0, every core)
+//' @param session Session from solar_session() (default: the global session)
+//' @return The number of threads now in use
+//' @export
+// [[Rcpp::export]]
+int solar_set_threads(int threads = 0, SEXP session = R_NilValue) {
+    if (threads < 0) {
+        stop("threads must be 0 or more");
+    }
+    SolarSession& state = get_session(session);
+    state.set_threads(static_cast<unsigned>(threads));
+    return static_cast<int>(state.get_threads());
+}
+
+//' Configure the EVD cache
+//'
+//' Traits with the same non-missing subjects share one eigendecomposition.
+//' Each EVD is cached under a hash of the ordered subject IDs, the kinship
+//' file's content, the kinship threshold and the EVD options, so a later fit
+//' on the same subjects skips building phi2 and the eigensolver. Sessions
+//' sharing a pedigree share its cache.
+//'
+//' Recently used decompositions stay in memory up to memory_mb. With
+//' disk_mb above zero they are also written to directory as .evd files,
+//' which later sessions (and later R processes) map back in; the least
+//' recently used files are deleted once the directory exceeds disk_mb.
+//'
+//' @param memory_mb Megabytes of EVDs kept in memory (default: 1024; 0 keeps
+//'   only those still in use)
+//' @param disk_mb Megabytes of EVD files kept on disk (default: 0, no disk cache)
+//' @param directory Disk cache directory (default: "", evd_cache in the
+//'   pedigree output directory)
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success
+//' @export
+// [[Rcpp::export]]
+int solar_set_evd_cache(double memory_mb = 1024, double disk_mb = 0, std::string directory = "",
+                        SEXP session = R_NilValue) {
+    if (!(memory_mb >= 0) || !(disk_mb >= 0)) {
+        stop("memory_mb and disk_mb must be 0 or more");
+    }
+    get_session(session).set_evd_cache(static_cast<size_t>(memory_mb * 1048576.0),
+                                       static_cast<uint64_t>(disk_mb * 1048576.0), directory);
+    return 0;
+}
+
+//' Set when EVDs are downdated instead of recomputed
+//'
+//' A trait that lacks values for a few subjects of a decomposition already
+//' in the EVD cache does not need a new eigendecomposition: those subjects
+//' are removed from the cached one, one secular-equation update per
+//' subject, at the cost of one matrix product for the subject's family
+//' block. The downdate is used while its estimated cost stays below
+//' crossover times that of a new decomposition; a dense EVD crosses over
+//' at about four subjects, a block-diagonal EVD much later.
+//'
+//' Downdates are off until this is called with a positive crossover, so by
+//' default every EVD is a fresh decomposition and results do not depend on
+//' what was decomposed earlier in the session. A downdated EVD matches a
+//' fresh one to rounding error (eigenvalues within about 1e-10, FPHI
+//' estimates within about 1e-8) but is not bit-identical to it.
+//'
+//' @param crossover Largest estimated downdate cost as a fraction of a new
+//'   decomposition (default: 1 when called; 0 turns downdates off again)
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success
+//' @export
+// [[Rcpp::export]]
+int solar_set_evd_downdate(double crossover = 1, SEXP session = R_NilValue) {
+    if (!(crossover >= 0)) {
+        stop("crossover must be 0 or more");
+    }
+    get_session(session).set_downdate_crossover(crossover);
+    return 0;
+}
+
+//' Approximate EVDs by their leading components
+//'
+//' For cohorts too large for a full eigendecomposition of phi2, only the
+//' leading eigenpairs are computed, by randomized subspace iteration on the
+//' sparse kinship matrix, and the remaining eigenvalues are fitted as a
+//' single value: their mean, which the trace of phi2 gives exactly. Each
+//' decomposition prints the number of components kept, the largest
+//' eigenpair residual and how far the remaining eigenvalues spread about
+//' their mean, as the error of the approximation. Block-diagonal EVDs
+//' are always exact.
+//'
+//' @param rank Leading components to keep (default: 0, choose by tolerance)
+//' @param tolerance With rank 0, add components (from 32, doubling) until
+//'   the remaining eigenvalues' RMS spread is at most this fraction of
+//'   their mean (default: 0; with rank 0, exact EVDs)
+//' @param session Session from solar_session() (default: the global session)
+//' @return Returns 0 on success
+//' @export
+// [[Rcpp::export]]
+int solar_set_evd_truncation(double rank = 0, double tolerance = 0, SEXP session = R_NilValue) {
+    if (!(rank >= 0) || !(tolerance >= 0)) {
+        stop("rank and tolerance must be 0 or more");
+    }
+    get_session(session).set_evd_truncation(static_cast<size_t>(rank), tolerance);
+    return 0;
+}
+
+//' Report compiled-in backends
+//'
+//' Show which optional backends this build of the package uses: OpenMP
+//' (Eigen's threaded matrix products), the BLAS and LAPACK that R is linked
+//' against (used by the "dsyevd" and "dsyevr" eigensolvers, and threaded
+//' when R uses OpenBLAS, MKL or Accelerate), and the other code paths
+//' chosen at compile time.
+//'
+//' @return A list with openmp (logical), openmp_version (OpenMP
+//'   specification date as yyyymm, NA without OpenMP), openmp_threads,
+//'   blas and lapack (library paths reported by R, NA if unknown),
+//'   eigensolver (the backend "auto" selects), eigen and zlib (versions),
+//'   sse2 (SIMD CSV tokenizer), from_chars (std::from_chars number parsing)
+//'   and cores
+//' @export
+// [[Rcpp::export]]
+List solar_build_info() {
+    // BLAS and LAPACK are R's, so ask R which libraries those are
+    String blas = NA_STRING;
+    String lapack = NA_STRING;
+    try {
+        Environment base = Environment::base_namespace();
+        Function ext_soft_version = base["extSoftVersion"];
+        CharacterVector versions = ext_soft_version();
+        CharacterVector names = versions.names();
+        for (R_xlen_t i = 0; i < versions.size(); i++) {
+            if (names[i] == "BLAS" && versions[i] != "") {
+                blas = versions[i];
+            }
+        }
+        Function la_library = base["La_library"];
+        CharacterVector library = la_library();
+        if (library.size() == 1 && library[0] != "") {
+            lapack = library[0];
+        }
+    } catch (...) {
+        // Older R without extSoftVersion()/La_library(): leave NA
+    }
+
+    int openmp_version = BuildInfo::openmp_version();
+    return List::create(
+        _["openmp"] = BuildInfo::openmp(),
+        _["openmp_version"] = openmp_version > 0 ? openmp_version : NA_INTEGER,
+        _["openmp_threads"] = BuildInfo::openmp_threads(),
+        _["blas"] = blas,
+        _["lapack"] = lapack,
+        _["eigensolver"] = EigenSolver::name(EigenSolver::resolve(EigenSolverBackend::Auto)),
+        _["eigen"] = BuildInfo::eigen(),
+        _["zlib"] = BuildInfo::zlib(),
+        _["sse2"] = BuildInfo::sse2(),
+        _["from_chars"] = BuildInfo::from_chars(),
+        _["cores"] = static_cast<int>(hardware_thread_count()));
 }
 
 //' Reset session state
@@ -79,8 +902,13 @@ int solar_run_fphi(std::string output_basename = "fphi_output") {
 //' Clear all loaded data (pedigree, phenotypes, selected trait).
 //' Useful for starting a new analysis or freeing memory.
 //'
+//' @param session Session from solar_session() (default: the global session)
 //' @export
 // [[Rcpp::export]]
-void solar_reset() {
-    g_default_session.reset();
+void solar_reset(SEXP session = R_NilValue) {
+    if (Rf_isNull(session)) {
+        g_default_session.reset();
+    } else {
+        get_session(session).reset();
+    }
 }
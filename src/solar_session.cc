@@ -1,3 +1,6 @@
+#include <cmath>
+#include <random>
+
 #include <Rcpp.h>
 #define COUT Rcpp::Rcout
 #define CERR Rcpp::Rcerr
@@ -5,20 +8,60 @@
 #include "solar_session.h"
 #include "pedigree_loader.h"
 #include "create_evd.h"
+#include "eigen_solver.h"
+#include "evd.h"
+#include "evd_downdate.h"
 #include "fphi.h"
+#include "genotype_matrix.h"
+#include "missingness_plan.h"
+#include "phenotype_cache.h"
+#include "parallel_for.h"
+
+uint64_t SharedPedigree::kinship_fingerprint() {
+    std::call_once(fingerprinted_, [&] {
+        if (EvdCache::file_fingerprint(kinship_file, fingerprint_) != 0) {
+            // Gone since the load: a fingerprint no other load shares, so
+            // this pedigree's EVDs are still cached but never matched on disk
+            CERR << "Warning: Cannot read " << kinship_file << " to fingerprint it for the EVD cache" << std::endl;
+            fingerprint_ = std::random_device()();
+            fingerprint_ = (fingerprint_ << 32) ^ std::random_device()();
+        }
+    });
+    return fingerprint_;
+}
+
+void SharedPedigree::set_kinship_fingerprint(uint64_t fingerprint) {
+    std::call_once(fingerprinted_, [&] { fingerprint_ = fingerprint; });
+}
 
 int SolarSession::load_pedigree(const std::string& file, double threshold, const std::string& output_dir) {
     COUT << "Loading pedigree: " << file << std::endl;
 
+    PedigreeLoader::Builder builder;
+    builder.from_file(file);
+    return load_pedigree(builder, threshold, output_dir, file, 0);
+}
+
+int SolarSession::load_pedigree(const KinshipTable& table, double threshold, const std::string& output_dir) {
+    COUT << "Loading pedigree: " << table.ida.size() << " kinship rows from memory" << std::endl;
+
+    PedigreeLoader::Builder builder;
+    builder.from_table(table);
+    return load_pedigree(builder, threshold, output_dir, "", EvdCache::table_fingerprint(table));
+}
+
+int SolarSession::load_pedigree(PedigreeLoader::Builder& builder, double threshold, const std::string& output_dir,
+                                const std::string& kinship_file, uint64_t kinship_fingerprint) {
     if (threshold > 0.0) {
         COUT << "  Using kinship threshold: " << threshold << std::endl;
     }
 
     COUT << "  Output directory: " << output_dir << std::endl;
 
+    ThreadPool::Scope threads(pool());
+
     // Use PedigreeLoader Builder pattern with provided output directory
-    auto loader = PedigreeLoader::Builder()
-        .from_file(file)
+    auto loader = builder
         .with_threshold(threshold)
         .with_output_dir(output_dir)
         .build();
@@ -28,25 +71,45 @@ int SolarSession::load_pedigree(const std::string& file, double threshold, const
         return 1;
     }
 
-    pedigree_ = loader->load();
+    std::unique_ptr<Pedigree> pedigree = loader->load();
 
-    if (!pedigree_) {
+    if (!pedigree) {
         CERR << "Error: Failed to load pedigree" << std::endl;
+        pedigree_.reset();
         return 1;
     }
 
-    // Store output directory and threshold for later use
-    output_dir_ = output_dir;
-    threshold_ = threshold;
-
     // Set sex variable
-    Pedigree::SexVar(pedigree_->sex_len() > 0 ? 1 : 0);
+    Pedigree::SexVar(pedigree->sex_len() > 0 ? 1 : 0);
+
+    // Store output directory and threshold for later use; a new
+    // SharedPedigree, so sessions sharing the old one keep it
+    auto shared = std::make_shared<SharedPedigree>();
+    shared->pedigree = std::move(pedigree);
+    shared->threshold = threshold;
+    shared->output_dir = output_dir;
+    shared->kinship_file = kinship_file;
+    if (kinship_file.empty()) {
+        shared->set_kinship_fingerprint(kinship_fingerprint);
+    }
+    pedigree_ = std::move(shared);
 
     COUT << "Pedigree loaded successfully" << std::endl;
     return 0;
 }
 
-int SolarSession::load_phenotypes(const std::string& file) {
+int SolarSession::share_pedigree(const SolarSession& other) {
+    if (!other.pedigree_) {
+        CERR << "Error: Cannot share pedigree - the other session has no pedigree loaded" << std::endl;
+        return 1;
+    }
+
+    pedigree_ = other.pedigree_;
+    COUT << "Sharing pedigree: " << pedigree_->pedigree->num_individuals() << " individuals" << std::endl;
+    return 0;
+}
+
+int SolarSession::load_phenotypes(const std::string& file, const std::vector<std::string>& columns) {
     if (!pedigree_) {
         CERR << "Error: Cannot load phenotypes - pedigree not loaded yet" << std::endl;
         CERR << "Please call solar_load_pedigree() first" << std::endl;
@@ -56,7 +119,7 @@ int SolarSession::load_phenotypes(const std::string& file) {
     COUT << "Loading phenotypes: " << file << std::endl;
 
     phenotypes_ = std::make_unique<Phenotypes>();
-    if (!phenotypes_->load(file)) {
+    if (!phenotypes_->load(file, columns)) {
         CERR << "Error: Failed to load phenotypes" << std::endl;
         phenotypes_.reset();
         return 1;
@@ -68,6 +131,103 @@ int SolarSession::load_phenotypes(const std::string& file) {
     return 0;
 }
 
+int SolarSession::load_phenotypes(std::unique_ptr<Phenotypes> phenotypes) {
+    if (!pedigree_) {
+        CERR << "Error: Cannot load phenotypes - pedigree not loaded yet" << std::endl;
+        CERR << "Please call solar_load_pedigree() first" << std::endl;
+        return 1;
+    }
+
+    COUT << "Loading phenotypes: " << phenotypes->get_filename() << std::endl;
+
+    phenotypes_ = std::move(phenotypes);
+    phenotypes_->describe();
+
+    COUT << "Phenotypes loaded successfully" << std::endl;
+    return 0;
+}
+
+int SolarSession::cache_phenotypes(const std::string& file) {
+    COUT << "Converting phenotypes: " << file << std::endl;
+
+    Phenotypes phenotypes;
+    if (!phenotypes.load_csv(file)) {
+        CERR << "Error: Failed to load phenotypes" << std::endl;
+        return 1;
+    }
+
+    if (PhenotypeCache::write(phenotypes, file) != 0) {
+        return 1;
+    }
+
+    COUT << "Phenotype cache written: " << PhenotypeCache::path_for(file) << std::endl;
+    return 0;
+}
+
+int SolarSession::load_genotypes(const std::string& prefix) {
+    if (!pedigree_) {
+        CERR << "Error: Cannot load genotypes - pedigree not loaded yet" << std::endl;
+        CERR << "Please call solar_load_pedigree() first" << std::endl;
+        return 1;
+    }
+
+    COUT << "Loading genotypes: " << prefix << std::endl;
+
+    ThreadPool::Scope threads(pool());
+    auto genotypes = std::make_unique<GenotypeMatrix>();
+    if (GenotypeMatrix::read_plink(prefix, *genotypes) != 0) {
+        CERR << "Error: Failed to load genotypes" << std::endl;
+        return 1;
+    }
+    return set_genotypes(std::move(genotypes));
+}
+
+int SolarSession::load_genotypes(const std::vector<std::string>& ids, const double* dosages, size_t n_markers) {
+    if (!pedigree_) {
+        CERR << "Error: Cannot load genotypes - pedigree not loaded yet" << std::endl;
+        CERR << "Please call solar_load_pedigree() first" << std::endl;
+        return 1;
+    }
+
+    COUT << "Loading genotypes: " << ids.size() << " subjects from memory" << std::endl;
+
+    ThreadPool::Scope threads(pool());
+    auto genotypes = std::make_unique<GenotypeMatrix>();
+    if (GenotypeMatrix::from_dosages(ids, dosages, n_markers, *genotypes) != 0) {
+        CERR << "Error: Failed to load genotypes" << std::endl;
+        return 1;
+    }
+    return set_genotypes(std::move(genotypes));
+}
+
+int SolarSession::set_genotypes(std::unique_ptr<GenotypeMatrix> genotypes) {
+    const IdDictionary& pedigree_ids = pedigree_->pedigree->ids();
+    size_t in_pedigree = 0;
+    for (size_t i = 0; i < pedigree_ids.size(); i++) {
+        if (genotypes->contains(std::string(pedigree_ids.name(static_cast<int>(i))))) {
+            in_pedigree++;
+        }
+    }
+
+    COUT << "  " << genotypes->num_subjects() << " subjects, " << genotypes->num_markers()
+         << " polymorphic markers (" << in_pedigree << " subjects in the pedigree)" << std::endl;
+    if (in_pedigree == 0) {
+        CERR << "Error: No genotyped subject is in the pedigree" << std::endl;
+        return 1;
+    }
+
+    genotypes_ = std::make_unique<GenotypeKinship>();
+    genotypes_->genotypes = std::move(genotypes);
+
+    COUT << "Genotypes loaded successfully; FPHI runs use the genotype GRM" << std::endl;
+    return 0;
+}
+
+void SolarSession::clear_genotypes() {
+    genotypes_.reset();
+    COUT << "Kinship: phi2 from the pedigree" << std::endl;
+}
+
 int SolarSession::select_trait(const std::string& trait) {
     if (!phenotypes_) {
         CERR << "Error: Cannot select trait - phenotypes not loaded yet" << std::endl;
@@ -79,11 +239,8 @@ int SolarSession::select_trait(const std::string& trait) {
     if (!phenotypes_->has_trait(trait)) {
         CERR << "Error: Trait '" << trait << "' not found in phenotype file" << std::endl;
         CERR << "Available traits:" << std::endl;
-        const auto& headers = phenotypes_->get_headers();
-        for (const auto& header : headers) {
-            if (header != "id" && header != "ID") {
-                CERR << "  - " << header << std::endl;
-            }
+        for (const auto& name : phenotypes_->get_trait_names()) {
+            CERR << "  - " << name << std::endl;
         }
         return 1;
     }
@@ -122,26 +279,22 @@ int SolarSession::run_fphi(const std::string& output_basename) {
     COUT << "======================================" << std::endl;
     COUT << std::endl;
 
+    ThreadPool::Scope threads(pool());
+
     // Step 1: Create EVD data
     COUT << "Creating EVD data..." << std::endl;
-    int evd_result = CreateEVD::create_evd_data(
-        pedigree_.get(),
-        phenotypes_.get(),
-        trait_,
-        output_basename.c_str()
-    );
-
-    if (evd_result != 0) {
+    if (decompose({trait_}, output_basename, evd_options_) != 0) {
         CERR << "Error: Failed to create EVD data for trait '" << trait_ << "'" << std::endl;
         return 1;
     }
 
-    // Step 2: Run FPHI analysis
+    // Step 2: Run FPHI analysis on the in-memory EVD
     COUT << "Running FPHI analysis..." << std::endl;
     int fphi_result = Fphi::run_fphi(
-        pedigree_.get(),
+        pedigree_->pedigree.get(),
         phenotypes_.get(),
         trait_,
+        *evd_,
         output_basename.c_str()
     );
 
@@ -159,10 +312,510 @@ int SolarSession::run_fphi(const std::string& output_basename) {
     return 0;
 }
 
+int SolarSession::run_fphi_batch(const std::vector<std::string>& traits, const std::string& output_basename) {
+    std::vector<FphiResult> results;
+    return fit_fphi(traits, output_basename, results);
+}
+
+int SolarSession::fit_fphi(const std::vector<std::string>& traits, const std::string& output_basename,
+                           std::vector<FphiResult>& results) {
+    if (!pedigree_) {
+        CERR << "Error: Cannot run FPHI - pedigree not loaded" << std::endl;
+        CERR << "Please call solar_load_pedigree() first" << std::endl;
+        return 1;
+    }
+
+    if (!phenotypes_) {
+        CERR << "Error: Cannot run FPHI - phenotypes not loaded" << std::endl;
+        CERR << "Please call solar_load_phenotype() first" << std::endl;
+        return 1;
+    }
+
+    bool write_files = !output_basename.empty();
+
+    // Default to every trait column in the phenotype file
+    std::vector<std::string> batch_traits = traits;
+    if (batch_traits.empty()) {
+        batch_traits = phenotypes_->get_trait_names();
+    }
+
+    for (const auto& trait : batch_traits) {
+        if (!phenotypes_->has_trait(trait)) {
+            CERR << "Error: Trait '" << trait << "' not found in phenotype file" << std::endl;
+            return 1;
+        }
+    }
+
+    if (batch_traits.empty()) {
+        CERR << "Error: No traits available for batch analysis" << std::endl;
+        return 1;
+    }
+
+    COUT << std::endl;
+    COUT << "======================================" << std::endl;
+    COUT << "FPHI Batch Analysis" << std::endl;
+    COUT << "======================================" << std::endl;
+    COUT << "Traits: " << batch_traits.size() << std::endl;
+    if (write_files) {
+        COUT << "Output Basename: " << output_basename << std::endl;
+    }
+    COUT << "======================================" << std::endl;
+    COUT << std::endl;
+
+    ThreadPool::Scope threads(pool());
+
+    // Step 1: Group traits by the subjects they are missing; each group
+    // gets one EVD. Without an output basename nothing is written;
+    // phi2.gz is still found in the pedigree's output directory
+    std::vector<TraitGroup> groups;
+    if (MissingnessPlan::plan(pedigree_->pedigree.get(), phenotypes_.get(), batch_traits, groups) != 0) {
+        return 1;
+    }
+    if (batch_traits.size() > 1) {
+        COUT << "Missingness patterns: " << groups.size() << " for " << batch_traits.size() << " traits ("
+             << batch_traits.size() - groups.size() << " decompositions saved)" << std::endl;
+    }
+
+    COUT << "Creating EVD data..." << std::endl;
+    EvdOptions options = evd_options_;
+    std::string evd_basename = output_basename;
+    if (!write_files) {
+        options.write_files = false;
+        const std::string& output_dir = pedigree_->output_dir;
+        evd_basename = output_dir.empty() ? "fphi" : output_dir + "/fphi";
+    }
+    std::vector<std::shared_ptr<const Evd>> evds;
+    if (decompose_groups(groups, evd_basename, options, evds) != 0) {
+        CERR << "Error: Failed to create EVD data for trait batch" << std::endl;
+        return 1;
+    }
+    evd_ = evds[0];
+
+    // Step 2: Project and fit each group's traits on its EVD
+    COUT << "Running FPHI analysis..." << std::endl;
+    results.assign(batch_traits.size(), FphiResult());
+    for (size_t g = 0; g < groups.size(); g++) {
+        std::vector<FphiResult> group_results;
+        int fphi_result = Fphi::run_fphi_batch(
+            pedigree_->pedigree.get(),
+            phenotypes_.get(),
+            groups[g].traits,
+            *evds[g],
+            nullptr,
+            &group_results
+        );
+
+        if (fphi_result != 0) {
+            CERR << "Error: FPHI batch analysis failed" << std::endl;
+            results.clear();
+            return 1;
+        }
+        for (size_t t = 0; t < group_results.size(); t++) {
+            results[groups[g].positions[t]] = group_results[t];
+        }
+    }
+
+    if (write_files) {
+        Fphi::write_batch_results(output_basename.c_str(), results);
+    }
+
+    COUT << std::endl;
+    COUT << "======================================" << std::endl;
+    COUT << "Analysis Complete" << std::endl;
+    COUT << "======================================" << std::endl;
+    if (write_files) {
+        COUT << "Output: " << output_basename << "_fphi_results.out" << std::endl;
+    }
+
+    return 0;
+}
+
+int SolarSession::decompose(const std::vector<std::string>& traits, const std::string& evd_basename,
+                            const EvdOptions& options) {
+    std::vector<std::string> subjects;
+    if (CreateEVD::select_subjects(pedigree_->pedigree.get(), phenotypes_.get(), traits, subjects) != 0) {
+        return 1;
+    }
+
+    if (genotypes_) {
+        std::shared_ptr<const Evd> evd;
+        if (decompose_genotypes(traits, subjects, evd_basename, options, evd) != 0) {
+            return 1;
+        }
+        evd_ = std::move(evd);
+        return 0;
+    }
+
+    // Same subjects, kinship and options as a cached decomposition
+    EvdCacheOptions cache_options = evd_cache_options();
+    std::string key = EvdCache::key(subjects, pedigree_->kinship_fingerprint(), pedigree_->threshold, options);
+    std::string lineage = EvdCache::lineage(pedigree_->kinship_fingerprint(), pedigree_->threshold, options);
+    std::shared_ptr<const Evd> evd = pedigree_->evds.find(key, subjects, lineage, cache_options);
+    if (evd) {
+        COUT << "  Reusing EVD of " << evd->num_subjects() << " subjects" << std::endl;
+        if (options.write_files &&
+            CreateEVD::write_evd_files(phenotypes_.get(), traits, *evd, evd_basename.c_str()) != 0) {
+            return 1;
+        }
+        evd_ = std::move(evd);
+        return 0;
+    }
+
+    // A few subjects short of a cached decomposition
+    evd = downdate_cached(subjects, options);
+    if (evd) {
+        pedigree_->evds.insert(key, evd, lineage, cache_options);
+        if (options.write_files &&
+            CreateEVD::write_evd_files(phenotypes_.get(), traits, *evd, evd_basename.c_str()) != 0) {
+            return 1;
+        }
+        evd_ = std::move(evd);
+        return 0;
+    }
+
+    auto created = std::make_shared<Evd>();
+    if (CreateEVD::create_evd_data(pedigree_->pedigree.get(), phenotypes_.get(), traits,
+                                   evd_basename.c_str(), *created, options) != 0) {
+        return 1;
+    }
+
+    evd_ = created;
+    pedigree_->evds.insert(key, evd_, lineage, cache_options);
+    return 0;
+}
+
+int SolarSession::decompose_genotypes(const std::vector<std::string>& traits,
+                                      const std::vector<std::string>& subjects,
+                                      const std::string& evd_basename, const EvdOptions& options,
+                                      std::shared_ptr<const Evd>& evd) {
+    const GenotypeMatrix& genotypes = *genotypes_->genotypes;
+    std::vector<std::string> genotyped;
+    for (const auto& id : subjects) {
+        if (genotypes.contains(id)) {
+            genotyped.push_back(id);
+        }
+    }
+    if (genotyped.size() < subjects.size()) {
+        COUT << "  " << subjects.size() - genotyped.size() << " subjects without genotypes left out" << std::endl;
+    }
+    if (genotyped.empty()) {
+        CERR << "Error: No phenotyped subject has genotypes" << std::endl;
+        return 1;
+    }
+
+    // A genotype EVD is always one dense block, and already low-rank
+    EvdOptions genotype_options = options;
+    genotype_options.block_diagonal = false;
+    genotype_options.truncated_rank = 0;
+    genotype_options.truncated_tolerance = 0.0;
+    EvdCacheOptions cache_options = evd_cache_options();
+    std::string key = EvdCache::key(genotyped, genotypes.fingerprint(), 0.0, genotype_options);
+    std::string lineage = EvdCache::lineage(genotypes.fingerprint(), 0.0, genotype_options);
+    evd = genotypes_->evds.find(key, genotyped, lineage, cache_options);
+    if (evd) {
+        COUT << "  Reusing EVD of " << evd->num_subjects() << " subjects" << std::endl;
+    } else {
+        auto created = std::make_shared<Evd>();
+        if (genotypes.decompose(genotyped, options.solver, *created) != 0) {
+            return 1;
+        }
+        COUT << "  Low-rank EVD of " << created->num_subjects() << " subjects from " << genotypes.num_markers()
+             << " markers: " << created->num_components() << " components, "
+             << created->num_remainder() << " in the null space" << std::endl;
+        evd = std::move(created);
+        genotypes_->evds.insert(key, evd, lineage, cache_options);
+    }
+
+    if (options.write_files &&
+        CreateEVD::write_evd_files(phenotypes_.get(), traits, *evd, evd_basename.c_str()) != 0) {
+        return 1;
+    }
+    return 0;
+}
+
+std::shared_ptr<const Evd> SolarSession::downdate_cached(const std::vector<std::string>& subjects,
+                                                         const EvdOptions& options) {
+    // A truncated EVD lacks the eigenvectors a downdate rotates, and one
+    // cut down from an exact EVD would not be truncated
+    if (options.downdate_crossover <= 0.0 || options.is_truncated()) {
+        return nullptr;
+    }
+
+    // The cached superset that is cheapest to cut down: one of the same
+    // kinship, threshold, mode and solver, with every eigenvector
+    std::string lineage = EvdCache::lineage(pedigree_->kinship_fingerprint(), pedigree_->threshold, options);
+    std::shared_ptr<const Evd> base;
+    std::vector<size_t> removed, candidate_removed;
+    double best_ratio = options.downdate_crossover;
+    for (const auto& candidate : pedigree_->evds.in_memory(lineage)) {
+        if (!candidate->is_complete() ||
+            !EvdDowndate::rows_to_remove(candidate->ids, subjects, candidate_removed) ||
+            candidate_removed.empty()) {
+            continue;
+        }
+        double ratio = EvdDowndate::cost_ratio(*candidate, candidate_removed);
+        if (ratio <= best_ratio) {
+            best_ratio = ratio;
+            base = candidate;
+            removed.swap(candidate_removed);
+        }
+    }
+    if (!base) {
+        return nullptr;
+    }
+
+    auto evd = std::make_shared<Evd>();
+    if (EvdDowndate::remove_rows(*base, removed, *evd) != 0) {
+        return nullptr;
+    }
+    COUT << "  Downdated EVD of " << base->num_subjects() << " subjects by " << removed.size()
+         << " to " << evd->num_subjects() << std::endl;
+    return evd;
+}
+
+int SolarSession::decompose_groups(const std::vector<TraitGroup>& groups, const std::string& evd_basename,
+                                   const EvdOptions& options, std::vector<std::shared_ptr<const Evd>>& evds) {
+    // A single pattern keeps the one-EVD layout of the output files
+    if (groups.size() == 1) {
+        if (decompose(groups[0].traits, evd_basename, options) != 0) {
+            return 1;
+        }
+        evds.assign(1, evd_);
+        return 0;
+    }
+
+    // Genotype EVDs: one thin SVD per pattern, each already O(n m^2)
+    if (genotypes_) {
+        evds.assign(groups.size(), nullptr);
+        for (size_t g = 0; g < groups.size(); g++) {
+            std::string basename = evd_basename + "_pattern" + std::to_string(g + 1);
+            if (decompose_genotypes(groups[g].traits, groups[g].subjects, basename, options, evds[g]) != 0) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    EvdCacheOptions cache_options = evd_cache_options();
+    std::string lineage = EvdCache::lineage(pedigree_->kinship_fingerprint(), pedigree_->threshold, options);
+    std::vector<std::string> keys(groups.size());
+    std::vector<size_t> missing;
+    std::vector<std::vector<std::string>> missing_subjects;
+    evds.assign(groups.size(), nullptr);
+    for (size_t g = 0; g < groups.size(); g++) {
+        keys[g] = EvdCache::key(groups[g].subjects, pedigree_->kinship_fingerprint(), pedigree_->threshold, options);
+        evds[g] = pedigree_->evds.find(keys[g], groups[g].subjects, lineage, cache_options);
+        if (!evds[g]) {
+            missing.push_back(g);
+            missing_subjects.push_back(groups[g].subjects);
+        }
+    }
+
+    if (missing.size() < groups.size()) {
+        COUT << "  Reusing " << groups.size() - missing.size() << " cached EVDs" << std::endl;
+    }
+
+    // Patterns to decompose run in parallel from one read of phi2.gz
+    auto decompose_sets = [&](const std::vector<size_t>& sets) {
+        if (sets.empty()) {
+            return 0;
+        }
+        COUT << "  Decomposing " << sets.size() << " subject sets" << std::endl;
+        std::vector<std::vector<std::string>> subject_sets;
+        for (size_t g : sets) {
+            subject_sets.push_back(groups[g].subjects);
+        }
+        std::vector<Evd> created;
+        if (CreateEVD::compute_eigen_decompositions(pedigree_->pedigree.get(), subject_sets,
+                                                    evd_basename.c_str(), created, options) != 0) {
+            return 1;
+        }
+        for (size_t k = 0; k < sets.size(); k++) {
+            auto evd = std::make_shared<const Evd>(std::move(created[k]));
+            pedigree_->evds.insert(keys[sets[k]], evd, lineage, cache_options);
+            evds[sets[k]] = std::move(evd);
+        }
+        return 0;
+    };
+
+    // Downdate from a cached superset where that is cheaper
+    auto downdate_sets = [&](const std::vector<size_t>& sets, std::vector<size_t>& failed) {
+        for (size_t g : sets) {
+            evds[g] = downdate_cached(groups[g].subjects, options);
+            if (evds[g]) {
+                pedigree_->evds.insert(keys[g], evds[g], lineage, cache_options);
+            } else {
+                failed.push_back(g);
+            }
+        }
+    };
+
+    std::vector<size_t> undecomposed;
+    downdate_sets(missing, undecomposed);
+
+    // A set a few subjects short of a larger missing set waits for that
+    // set's EVD and is downdated from it (judged by the dense estimate,
+    // which is the most expensive case)
+    std::stable_sort(undecomposed.begin(), undecomposed.end(), [&](size_t a, size_t b) {
+        return groups[a].subjects.size() > groups[b].subjects.size();
+    });
+    std::vector<size_t> first, later;
+    std::vector<size_t> removed;
+    for (size_t g : undecomposed) {
+        bool derivable = false;
+        for (size_t f : first) {
+            if (options.downdate_crossover > 0.0 && !options.is_truncated() &&
+                EvdDowndate::rows_to_remove(groups[f].subjects, groups[g].subjects, removed) &&
+                EvdDowndate::cost_ratio(groups[f].subjects.size(), removed.size()) <= options.downdate_crossover) {
+                derivable = true;
+                break;
+            }
+        }
+        (derivable ? later : first).push_back(g);
+    }
+
+    std::vector<size_t> remaining;
+    if (decompose_sets(first) != 0) {
+        return 1;
+    }
+    downdate_sets(later, remaining);
+    if (decompose_sets(remaining) != 0) {
+        return 1;
+    }
+
+    // One set of EVD files per pattern: <basename>_pattern<g>.ids/.notes/.evd
+    if (options.write_files) {
+        for (size_t g = 0; g < groups.size(); g++) {
+            std::string basename = evd_basename + "_pattern" + std::to_string(g + 1);
+            if (CreateEVD::write_evd_files(phenotypes_.get(), groups[g].traits, *evds[g], basename.c_str()) != 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void SolarSession::set_evd_cache(size_t memory_limit, uint64_t disk_limit, const std::string& directory) {
+    evd_cache_.memory_limit = memory_limit;
+    evd_cache_.disk_limit = disk_limit;
+    evd_cache_.directory = directory;
+    if (pedigree_) {
+        pedigree_->evds.trim(evd_cache_options());
+        if (genotypes_) {
+            genotypes_->evds.trim(evd_cache_options());
+        }
+    }
+
+    COUT << "EVD cache: " << memory_limit / (1 << 20) << " MB in memory";
+    if (disk_limit > 0) {
+        COUT << ", " << disk_limit / (1 << 20) << " MB on disk";
+        if (!directory.empty()) {
+            COUT << " in " << directory;
+        }
+    }
+    COUT << std::endl;
+}
+
+void SolarSession::set_evd_truncation(size_t rank, double tolerance) {
+    evd_options_.truncated_rank = rank;
+    evd_options_.truncated_tolerance = rank > 0 || !(tolerance > 0.0) ? 0.0 : tolerance;
+    if (rank > 0) {
+        COUT << "Truncated EVD: " << rank << " leading components" << std::endl;
+    } else if (evd_options_.truncated_tolerance > 0.0) {
+        COUT << "Truncated EVD: leading components until the rest spread within "
+             << evd_options_.truncated_tolerance << " of their mean" << std::endl;
+    } else {
+        COUT << "Truncated EVD: off" << std::endl;
+    }
+}
+
+void SolarSession::set_downdate_crossover(double crossover) {
+    evd_options_.downdate_crossover = crossover > 0.0 ? crossover : 0.0;
+    if (evd_options_.downdate_crossover > 0.0) {
+        COUT << "EVD downdates: up to " << evd_options_.downdate_crossover
+             << " x the cost of a new decomposition" << std::endl;
+    } else {
+        COUT << "EVD downdates: off" << std::endl;
+    }
+}
+
+EvdCacheOptions SolarSession::evd_cache_options() const {
+    EvdCacheOptions options = evd_cache_;
+    if (options.directory.empty()) {
+        const std::string& output_dir = pedigree_->output_dir;
+        options.directory = output_dir.empty() ? "evd_cache" : output_dir + "/evd_cache";
+    }
+    return options;
+}
+
+int SolarSession::set_eigen_solver(const std::string& solver) {
+    if (EigenSolver::parse(solver, evd_options_.solver) != 0) {
+        CERR << "Error: Unknown eigensolver '" << solver << "'" << std::endl;
+        CERR << "Available: auto, eispack, eigen, dsyevd, dsyevr" << std::endl;
+        return 1;
+    }
+    COUT << "Eigensolver: " << EigenSolver::name(EigenSolver::resolve(evd_options_.solver)) << std::endl;
+    return 0;
+}
+
+void SolarSession::set_threads(unsigned nthreads) {
+    if (nthreads != threads_) {
+        threads_ = nthreads;
+        pool_.reset();
+    }
+    COUT << "Threads: " << get_threads() << std::endl;
+}
+
+unsigned SolarSession::get_threads() const {
+    return threads_ > 0 ? threads_ : hardware_thread_count();
+}
+
+ThreadPool* SolarSession::pool() {
+    if (!pool_) {
+        pool_ = std::make_unique<ThreadPool>(get_threads());
+    }
+    return pool_.get();
+}
+
+int SolarSession::project_traits(const std::vector<std::string>& traits, Eigen::MatrixXd& projected) const {
+    if (!evd_) {
+        CERR << "Error: No EVD available - run an FPHI analysis first" << std::endl;
+        return 1;
+    }
+
+    if (!phenotypes_) {
+        CERR << "Error: Cannot project traits - phenotypes not loaded" << std::endl;
+        return 1;
+    }
+
+    size_t n_subjects = evd_->num_subjects();
+    Eigen::MatrixXd values(n_subjects, traits.size());
+    for (size_t t = 0; t < traits.size(); t++) {
+        int index = phenotypes_->find_trait(traits[t]);
+        if (index == -1) {
+            CERR << "Error: Trait '" << traits[t] << "' not found in phenotype data" << std::endl;
+            return 1;
+        }
+        const double* column = phenotypes_->get_trait(index);
+        for (size_t i = 0; i < n_subjects; i++) {
+            int row = phenotypes_->find_row(evd_->ids[i]);
+            if (row == -1 || std::isnan(column[row])) {
+                CERR << "Error: Cannot find phenotype value for ID: " << evd_->ids[i]
+                     << " (trait '" << traits[t] << "')" << std::endl;
+                return 1;
+            }
+            values(i, t) = column[row];
+        }
+    }
+
+    projected = evd_->project(values);
+    return 0;
+}
+
 void SolarSession::reset() {
     pedigree_.reset();
     phenotypes_.reset();
+    evd_.reset();
+    genotypes_.reset();
     trait_.clear();
-    threshold_ = 0.0;
-    output_dir_.clear();
 }
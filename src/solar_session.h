@@ -2,9 +2,57 @@
 #define SOLAR_SESSION_H
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "pedigree.h"
+#include "pedigree_loader.h"
 #include "phenotypes.h"
+#include "create_evd.h"
+#include "evd.h"
+#include "evd_cache.h"
+#include "fphi.h"
+#include "genotype_matrix.h"
+#include "missingness_plan.h"
+#include "thread_pool.h"
+
+/**
+ * SharedPedigree - Pedigree state that several sessions can hold at once
+ *
+ * The pedigree is immutable once loaded, so sessions analysing the same
+ * kinship point at one SharedPedigree instead of reloading it. The
+ * decompositions computed from it go into one EvdCache, keyed by subject
+ * set and kinship fingerprint, so any session fitting a subject set seen
+ * before reuses the EVD instead of recomputing it.
+ */
+struct SharedPedigree {
+    std::shared_ptr<const Pedigree> pedigree;
+    double threshold = 0.0;
+    std::string output_dir;  // Where phi2.gz was written
+    std::string kinship_file;  // Kinship file the pedigree came from (empty for a table)
+    EvdCache evds;
+
+    // Fingerprint of the kinship file or table the pedigree came from. A
+    // table's is set at load; a file is only read for it on the first EVD
+    // cache lookup, so a load never pays a second pass over a large file
+    uint64_t kinship_fingerprint();
+    void set_kinship_fingerprint(uint64_t fingerprint);
+
+private:
+    std::once_flag fingerprinted_;
+    uint64_t fingerprint_ = 0;
+};
+
+/**
+ * GenotypeKinship - Genotypes standing in for phi2 in a session
+ *
+ * Their low-rank decompositions are cached apart from the pedigree's, so
+ * one is never reused or downdated as if it were the other.
+ */
+struct GenotypeKinship {
+    std::unique_ptr<const GenotypeMatrix> genotypes;
+    EvdCache evds;
+};
 
 /**
  * SolarSession - Session manager for FPHI analysis
@@ -16,7 +64,8 @@
  * 4. run_fphi() - Run FPHI analysis
  *
  * This class encapsulates all analysis state without using globals,
- * making it suitable for the R package interface.
+ * making it suitable for the R package interface. Sessions are independent
+ * except that share_pedigree() lets one use another's SharedPedigree.
  */
 class SolarSession {
 public:
@@ -38,13 +87,77 @@ public:
      */
     int load_pedigree(const std::string& file, double threshold, const std::string& output_dir);
 
+    /**
+     * Load pedigree from in-memory kinship rows (e.g. an R data.frame)
+     * @param table IDA, IDB and KIN columns; only read during the call
+     * @param threshold Kinship threshold (0.0 for theoretical, >0 for empirical)
+     * @param output_dir Directory where pedigree output files will be created
+     * @return 0 on success, 1 on failure
+     */
+    int load_pedigree(const KinshipTable& table, double threshold, const std::string& output_dir);
+
+    /**
+     * Use the pedigree (and cached decompositions) of another session
+     * @param other Session with a loaded pedigree
+     * @return 0 on success, 1 on failure
+     *
+     * Nothing is copied; loading a new pedigree into either session later
+     * leaves the other untouched. Phenotypes and trait are not shared.
+     */
+    int share_pedigree(const SolarSession& other);
+
     /**
      * Load phenotype file
      * @param file Path to phenotype CSV file
+     * @param columns Trait columns to load (empty for every non-ID column)
      * @return 0 on success, 1 on failure
      * @requires load_pedigree() must be called first
      */
-    int load_phenotypes(const std::string& file);
+    int load_phenotypes(const std::string& file, const std::vector<std::string>& columns = {});
+
+    /**
+     * Use phenotypes built in memory (see Phenotypes::load_columns)
+     * @param phenotypes Loaded phenotypes; the session takes ownership
+     * @return 0 on success, 1 on failure
+     * @requires load_pedigree() must be called first
+     */
+    int load_phenotypes(std::unique_ptr<Phenotypes> phenotypes);
+
+    /**
+     * Convert a phenotype CSV to its binary cache (<file>.solarphen), which
+     * load_phenotypes() then uses while the CSV is unchanged
+     * @param file Path to phenotype CSV file
+     * @return 0 on success, 1 on failure
+     */
+    int cache_phenotypes(const std::string& file);
+
+    /**
+     * Use genotypes instead of phi2 as the kinship of FPHI runs
+     * @param prefix PLINK binary fileset (<prefix>.bed, .bim and .fam)
+     * @return 0 on success, 1 on failure
+     * @requires load_pedigree() must be called first
+     *
+     * The kinship becomes the GRM Z Z^T / m of the standardized genotypes
+     * (see GenotypeMatrix). Each EVD comes from a thin SVD of the
+     * subjects' rows of Z, so with m markers it has at most m components
+     * and the null space is fitted exactly as one zero-eigenvalue group.
+     * Subjects without genotypes are left out of the fit.
+     */
+    int load_genotypes(const std::string& prefix);
+
+    /**
+     * Use in-memory allele counts as the kinship of FPHI runs
+     * @param ids Subject of each row
+     * @param dosages ids.size() x n_markers column-major allele counts
+     *        (NaN for missing); only read during the call
+     * @param n_markers Number of markers
+     * @return 0 on success, 1 on failure
+     * @requires load_pedigree() must be called first
+     */
+    int load_genotypes(const std::vector<std::string>& ids, const double* dosages, size_t n_markers);
+
+    /** Go back to phi2 as the kinship */
+    void clear_genotypes();
 
     /**
      * Select trait for analysis
@@ -60,37 +173,219 @@ public:
      * @return 0 on success, 1 on failure
      * @requires select_trait() must be called first
      *
-     * Creates output files:
+     * The EVD is kept in memory and passed straight to the fit.
+     *
+     * Creates output files (.ids, .evd and .notes only when EVD files
+     * are enabled, see set_write_evd_files()):
      *   - <output_basename>.ids
-     *   - <output_basename>.eigenvalues
-     *   - <output_basename>.eigenvectors
+     *   - <output_basename>.evd (binary eigendecomposition)
      *   - <output_basename>.notes
      *   - <output_basename>_fphi_results.out
      *   - <output_basename>_parameters.out
      */
     int run_fphi(const std::string& output_basename);
 
+    /**
+     * Run FPHI analysis for many traits with one EVD per missingness pattern
+     * @param traits Trait columns to analyse (empty = every non-ID column)
+     * @param output_basename Base name for output files
+     * @return 0 on success, 1 on failure
+     * @requires load_phenotypes() must be called first
+     *
+     * Each trait is fitted on every subject with a value for it. Traits
+     * missing the same subjects are grouped (see MissingnessPlan) and
+     * share one EVD; the groups' EVDs are built in parallel, then each
+     * group's traits are projected together and fitted in parallel.
+     *
+     * Creates output files (.ids, .evd and .notes only when EVD files
+     * are enabled, see set_write_evd_files(); with several patterns they
+     * are written once per pattern as <output_basename>_pattern<g>.*):
+     *   - <output_basename>.ids
+     *   - <output_basename>.evd (binary eigendecomposition)
+     *   - <output_basename>.notes
+     *   - <output_basename>_fphi_results.out (one row per trait)
+     *   - <output_basename>_parameters.out (one row per trait and parameter)
+     */
+    int run_fphi_batch(const std::vector<std::string>& traits, const std::string& output_basename);
+
+    /**
+     * Run batch FPHI and return the estimates instead of only writing them
+     * @param traits Trait columns (empty for every loaded trait)
+     * @param output_basename Base name for output files as in
+     *        run_fphi_batch(), or "" to write no files at all
+     * @param results Receives one FphiResult per trait, in trait order
+     * @return 0 on success, 1 on failure
+     * @requires load_phenotypes() must be called first
+     *
+     * The EVD (of the first trait's missingness pattern) stays available
+     * through get_evd() either way.
+     */
+    int fit_fphi(const std::vector<std::string>& traits, const std::string& output_basename,
+                 std::vector<FphiResult>& results);
+
+    /**
+     * Project traits onto the eigenvectors of the last run (U^T * Y)
+     * @param traits Trait columns, each non-missing for every EVD subject
+     * @param projected Receives a components x traits matrix
+     * @return 0 on success, 1 on failure
+     * @requires an FPHI run, so that get_evd() is set
+     */
+    int project_traits(const std::vector<std::string>& traits, Eigen::MatrixXd& projected) const;
+
+    /**
+     * Decompose phi2 one family block at a time
+     * @param enabled true for block-diagonal EVD, false for one dense EVD
+     *
+     * Each family's block is eigendecomposed independently (in parallel,
+     * largest first) and the eigenvectors stay block-sparse, so the cost is
+     * the sum of O(n_f^3) over families instead of O(n^3).
+     */
+    void set_block_evd(bool enabled) { evd_options_.block_diagonal = enabled; }
+
+    /**
+     * Write the EVD to disk during FPHI runs
+     * @param enabled true to write .ids/.evd/.notes files (default), false
+     *        to keep the decomposition in memory only
+     */
+    void set_write_evd_files(bool enabled) { evd_options_.write_files = enabled; }
+
+    /**
+     * Select the eigensolver used for the phi2 EVD
+     * @param solver "auto", "eispack", "eigen", "dsyevd" or "dsyevr"
+     * @return 0 on success, 1 for an unknown solver
+     *
+     * "auto" uses LAPACK dsyevd, which runs on R's BLAS and is threaded
+     * when R is linked against a threaded BLAS. "eispack" is the serial
+     * TRED2/TQL2 routine of the original SOLAR.
+     */
+    int set_eigen_solver(const std::string& solver);
+
+    /**
+     * Set the number of threads used for parsing, EVD blocks and fits
+     * @param nthreads Thread count including the calling thread (0 = every core)
+     *
+     * The session keeps one pool of worker threads for all of its work;
+     * it is started on first use and restarted when the count changes.
+     * Worker diagnostics are queued and printed on the R main thread.
+     */
+    void set_threads(unsigned nthreads);
+
+    /**
+     * Configure the cache of decompositions reused across traits
+     * @param memory_limit Bytes of EVDs kept in memory (0 = only those
+     *        still held by a session or R object)
+     * @param disk_limit Bytes of .evd files kept in directory (0 = no disk cache)
+     * @param directory Disk cache directory ("" = evd_cache in the
+     *        pedigree's output directory)
+     *
+     * EVDs are keyed by a hash of the ordered subject IDs, the kinship
+     * file's content, the threshold and the EVD options, so a trait with
+     * the same non-missing subjects as an earlier one skips phi2 and the
+     * eigensolver. The least recently used entries go first when a limit
+     * is exceeded; the disk cache outlives the session.
+     */
+    void set_evd_cache(size_t memory_limit, uint64_t disk_limit, const std::string& directory);
+
+    /**
+     * Set when an EVD is cut down from a cached one instead of recomputed
+     * @param crossover Largest estimated cost of the downdate, as a
+     *        fraction of a new decomposition (0 = always decompose, the
+     *        default)
+     *
+     * A subject set a few subjects short of a cached EVD's is derived
+     * from it by removing those subjects one rank-one secular update at
+     * a time (see EvdDowndate), costing one matrix product per subject
+     * for their family block instead of a full eigendecomposition. The
+     * result agrees with a fresh decomposition only to rounding, so
+     * downdates are opt-in.
+     */
+    void set_downdate_crossover(double crossover);
+
+    /**
+     * Approximate dense EVDs by their leading eigenpairs
+     * @param rank Components to keep (0 = choose by tolerance)
+     * @param tolerance With rank 0, keep adding components until the
+     *        other eigenvalues' RMS spread is at most this fraction of
+     *        their mean (0 with rank 0 = exact EVDs)
+     *
+     * For cohorts too large for a dense eigendecomposition, the leading
+     * eigenpairs come from randomized subspace iteration on the sparse
+     * phi2 (see RandomizedEvd) and the remaining eigenvalues are fitted
+     * as one group at their mean. The residuals and the spread are
+     * printed as the error of the approximation. Block-diagonal EVDs
+     * are always exact.
+     */
+    void set_evd_truncation(size_t rank, double tolerance);
+
+    /** Threads the session's pool runs (resolved when nthreads was 0) */
+    unsigned get_threads() const;
+
     // === Query Methods ===
 
     bool has_pedigree() const { return pedigree_ != nullptr; }
     bool has_phenotypes() const { return phenotypes_ != nullptr; }
     bool has_trait() const { return !trait_.empty(); }
+    bool has_genotypes() const { return genotypes_ != nullptr; }
 
     std::string get_trait_name() const { return trait_; }
-    Pedigree* get_pedigree() const { return pedigree_.get(); }
+    const Pedigree* get_pedigree() const { return pedigree_ ? pedigree_->pedigree.get() : nullptr; }
     Phenotypes* get_phenotypes() const { return phenotypes_.get(); }
 
+    /** EVD from the most recent FPHI run, or nullptr */
+    const Evd* get_evd() const { return evd_.get(); }
+
+    /** Shared handle to the same EVD, kept alive after reset() or a new run */
+    std::shared_ptr<const Evd> share_evd() const { return evd_; }
+
     /**
      * Reset session state (clear all loaded data)
      */
     void reset();
 
 private:
-    std::unique_ptr<Pedigree> pedigree_;
+    // Load through builder; kinship_file is fingerprinted later, and a
+    // table's fingerprint is given (with an empty kinship_file)
+    int load_pedigree(PedigreeLoader::Builder& builder, double threshold, const std::string& output_dir,
+                      const std::string& kinship_file, uint64_t kinship_fingerprint);
+
+    // Thread pool for this session's parallel loops, started on demand
+    ThreadPool* pool();
+
+    // Set evd_ to the decomposition for traits, reusing a cached one
+    // when the subjects and options match
+    int decompose(const std::vector<std::string>& traits, const std::string& evd_basename,
+                  const EvdOptions& options);
+
+    // Set evds[g] to the decomposition for groups[g]: cached ones are
+    // reused and the rest decomposed in parallel
+    int decompose_groups(const std::vector<TraitGroup>& groups, const std::string& evd_basename,
+                         const EvdOptions& options, std::vector<std::shared_ptr<const Evd>>& evds);
+
+    // EVD of subjects cut down from a cached superset by EvdDowndate, or
+    // nullptr when none is within options.downdate_crossover
+    std::shared_ptr<const Evd> downdate_cached(const std::vector<std::string>& subjects, const EvdOptions& options);
+
+    // Cache options with the directory resolved against the pedigree
+    EvdCacheOptions evd_cache_options() const;
+
+    // Use loaded genotypes as the kinship
+    int set_genotypes(std::unique_ptr<GenotypeMatrix> genotypes);
+
+    // Low-rank EVD of the genotyped subjects among subjects, from the
+    // genotype cache or a new thin SVD; written to evd_basename like any EVD
+    int decompose_genotypes(const std::vector<std::string>& traits, const std::vector<std::string>& subjects,
+                            const std::string& evd_basename, const EvdOptions& options,
+                            std::shared_ptr<const Evd>& evd);
+
+    std::shared_ptr<SharedPedigree> pedigree_;  // Pedigree, threshold and output directory
     std::unique_ptr<Phenotypes> phenotypes_;
+    std::shared_ptr<const Evd> evd_;  // Decomposition from the last run
+    std::unique_ptr<GenotypeKinship> genotypes_;  // Replaces phi2 when set
     std::string trait_;
-    double threshold_ = 0.0;
-    std::string output_dir_;  // Output directory for all analysis files
+    EvdOptions evd_options_;
+    EvdCacheOptions evd_cache_;
+    unsigned threads_ = 0;  // 0 = every core
+    std::unique_ptr<ThreadPool> pool_;
 };
 
 #endif // SOLAR_SESSION_H
@@ -0,0 +1,120 @@
+/*
+ * thread_pool.cc - Persistent worker threads for parallel_for
+ */
+
+#include "thread_pool.h"
+#include "build_info.h"
+
+namespace {
+    thread_local ThreadPool* current_pool = nullptr;
+    thread_local bool is_worker = false;
+}
+
+ThreadPool::ThreadPool(unsigned nthreads) {
+    for (unsigned t = 1; t < nthreads; t++) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+ThreadPool* ThreadPool::current() {
+    return current_pool;
+}
+
+bool ThreadPool::in_worker() {
+    return is_worker;
+}
+
+ThreadPool::Scope::Scope(ThreadPool* pool) : previous_(current_pool) {
+    current_pool = pool;
+}
+
+ThreadPool::Scope::~Scope() {
+    current_pool = previous_;
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& body) {
+    if (workers_.empty() || count <= 1 || is_worker) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body_ = &body;
+        count_ = count;
+        next_ = 0;
+        error_ = nullptr;
+        active_ = static_cast<unsigned>(workers_.size());
+        generation_++;
+    }
+    wake_.notify_all();
+
+    // The calling thread takes indices too; a loop nested in its bodies
+    // runs serially, as on the workers
+    is_worker = true;
+    work();
+    is_worker = false;
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return active_ == 0; });
+        body_ = nullptr;
+        error = error_;
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::worker_loop() {
+    is_worker = true;
+    // Kernels run from a loop body (Eigen products, an OpenMP BLAS) would
+    // otherwise each start a full OpenMP team
+    BuildInfo::single_threaded_openmp();
+    unsigned long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) {
+                return;
+            }
+            seen = generation_;
+        }
+
+        work();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_ == 0) {
+            done_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::work() {
+    for (size_t i = next_++; i < count_; i = next_++) {
+        try {
+            (*body_)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) error_ = std::current_exception();
+            next_ = count_;  // Stop handing out work
+        }
+    }
+}
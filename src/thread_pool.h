@@ -0,0 +1,76 @@
+/*
+ * thread_pool.h - Persistent worker threads for parallel_for
+ * A SolarSession owns one pool and makes it current (ThreadPool::Scope)
+ * while it loads or fits, so every parallel_for in that work runs on the
+ * session's threads instead of starting new ones. Loop bodies run off the
+ * R main thread: no R API calls, and diagnostics go through LogSink.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // nthreads counts the calling thread, so nthreads - 1 workers start
+    explicit ThreadPool(unsigned nthreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    // Run body(i) for every i in [0, count) on the workers and the calling
+    // thread, handing out indices dynamically; returns when all are done.
+    // The first exception thrown by any body is rethrown here
+    void run(size_t count, const std::function<void(size_t)>& body);
+
+    // Pool made current on this thread by a Scope, or nullptr
+    static ThreadPool* current();
+
+    // True on a pool's worker threads, and on the calling thread while it
+    // runs loop bodies (nested loops there run serially)
+    static bool in_worker();
+
+    // Makes a pool current on this thread for the lifetime of the scope
+    class Scope {
+    public:
+        explicit Scope(ThreadPool* pool);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        ThreadPool* previous_;
+    };
+
+private:
+    void worker_loop();
+    void work();
+
+    std::vector<std::thread> workers_;
+    std::mutex run_mutex_;  // One loop at a time
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* body_ = nullptr;
+    size_t count_ = 0;
+    std::atomic<size_t> next_{0};
+    unsigned long generation_ = 0;  // Bumped for every loop
+    unsigned active_ = 0;           // Workers still inside the current loop
+    bool stop_ = false;
+    std::exception_ptr error_;
+};
+
+#endif // THREAD_POOL_H
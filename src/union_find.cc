@@ -0,0 +1,117 @@
+/*
+ * union_find.cc - Disjoint-set forest implementations
+ */
+
+#include <utility>
+
+#include "union_find.h"
+
+// === DisjointSet ===
+
+DisjointSet::DisjointSet(size_t count)
+    : parent_(count),
+      size_(count, 1),
+      num_sets_(count) {
+    for (size_t i = 0; i < count; i++) {
+        parent_[i] = static_cast<int>(i);
+    }
+}
+
+int DisjointSet::add() {
+    int x = static_cast<int>(parent_.size());
+    parent_.push_back(x);
+    size_.push_back(1);
+    num_sets_++;
+    return x;
+}
+
+int DisjointSet::find(int x) {
+    while (parent_[x] != x) {
+        parent_[x] = parent_[parent_[x]];
+        x = parent_[x];
+    }
+    return x;
+}
+
+bool DisjointSet::unite(int a, int b) {
+    a = find(a);
+    b = find(b);
+    if (a == b) {
+        return false;
+    }
+
+    // Union by size
+    if (size_[a] < size_[b]) {
+        std::swap(a, b);
+    }
+    parent_[b] = a;
+    size_[a] += size_[b];
+    num_sets_--;
+    return true;
+}
+
+int DisjointSet::label_sets(std::vector<int>& labels) {
+    size_t n = parent_.size();
+    std::vector<int> label_of_root(n, 0);
+    labels.assign(n, 0);
+
+    int nsets = 0;
+    for (size_t i = 0; i < n; i++) {
+        int root = find(static_cast<int>(i));
+        if (label_of_root[root] == 0) {
+            label_of_root[root] = ++nsets;
+        }
+        labels[i] = label_of_root[root];
+    }
+    return nsets;
+}
+
+// === ConcurrentDisjointSet ===
+
+ConcurrentDisjointSet::ConcurrentDisjointSet(size_t count)
+    : count_(count),
+      parent_(new std::atomic<int>[count]) {
+    for (size_t i = 0; i < count; i++) {
+        parent_[i].store(static_cast<int>(i), std::memory_order_relaxed);
+    }
+}
+
+int ConcurrentDisjointSet::find(int x) const {
+    int parent = parent_[x].load(std::memory_order_acquire);
+    while (parent != x) {
+        // Path halving; a failed exchange just means another thread helped
+        int grandparent = parent_[parent].load(std::memory_order_acquire);
+        parent_[x].compare_exchange_weak(parent, grandparent, std::memory_order_acq_rel);
+        x = grandparent;
+        parent = parent_[x].load(std::memory_order_acquire);
+    }
+    return x;
+}
+
+bool ConcurrentDisjointSet::unite(int a, int b) {
+    while (true) {
+        a = find(a);
+        b = find(b);
+        if (a == b) {
+            return false;
+        }
+        if (a > b) {
+            std::swap(a, b);
+        }
+
+        // Link root b under a, retrying if b stopped being a root
+        int expected = b;
+        if (parent_[b].compare_exchange_strong(expected, a, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+}
+
+DisjointSet ConcurrentDisjointSet::to_disjoint_set() const {
+    DisjointSet set(count_);
+    for (size_t i = 0; i < count_; i++) {
+        int root = find(static_cast<int>(i));
+        set.unite(static_cast<int>(i), root);
+    }
+    return set;
+}
@@ -0,0 +1,69 @@
+/*
+ * union_find.h - Disjoint-set forests for family (connected component) detection
+ * DisjointSet grows as subjects are interned and is merged edge by edge while
+ * kinship rows are parsed; ConcurrentDisjointSet is a fixed-size lock-free
+ * variant for merging from several parser threads at once
+ */
+
+#ifndef UNION_FIND_H
+#define UNION_FIND_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class DisjointSet {
+public:
+    DisjointSet() = default;
+    explicit DisjointSet(size_t count);
+
+    // Add a new singleton set and return its element index
+    int add();
+
+    // Representative of the set containing x (with path halving)
+    int find(int x);
+
+    // Merge the sets containing a and b; returns false if already merged
+    bool unite(int a, int b);
+
+    // Number of elements in the set containing x
+    int set_size(int x) { return size_[find(x)]; }
+
+    size_t size() const { return parent_.size(); }
+    size_t num_sets() const { return num_sets_; }
+
+    // Label every element with its set number (1, 2, ...), numbering sets in
+    // order of their lowest element; returns the number of sets
+    int label_sets(std::vector<int>& labels);
+
+private:
+    std::vector<int> parent_;
+    std::vector<int> size_;
+    size_t num_sets_ = 0;
+};
+
+class ConcurrentDisjointSet {
+public:
+    explicit ConcurrentDisjointSet(size_t count);
+
+    // Safe to call concurrently with unite() from any number of threads
+    int find(int x) const;
+
+    // Merge the sets containing a and b (lock-free, the larger index is
+    // always linked under the smaller so concurrent merges cannot cycle)
+    bool unite(int a, int b);
+
+    size_t size() const { return count_; }
+
+    // Copy the final forest into a serial DisjointSet (call after all
+    // threads have finished merging)
+    DisjointSet to_disjoint_set() const;
+
+private:
+    size_t count_;
+    std::unique_ptr<std::atomic<int>[]> parent_;
+};
+
+#endif // UNION_FIND_H